@@ -1,5 +1,7 @@
 #include "activation.h"
 
+#include <stdexcept> // For runtime_error
+
 Activation ActivationFunctions::sigmoid = {
 	[](double x) -> double
 	{
@@ -38,4 +40,93 @@ Activation ActivationFunctions::tanh = {
 	[](double x) -> double
 	{
 		return 1.0 - x * x;
-	}};
\ No newline at end of file
+	}};
+
+Activation ActivationFunctions::softmax = {
+	[](double x) -> double
+	{
+		return x;
+	},
+	[](double) -> double
+	{
+		return 1.0;
+	},
+	::softmax};
+
+Activation ActivationFunctions::linear = {
+	[](double x) -> double
+	{
+		return x;
+	},
+	[](double) -> double
+	{
+		return 1.0;
+	}};
+
+unsigned int ActivationFunctions::id(const Activation &activation)
+{
+	// Softmax and linear share identical function and derivative bodies, which the linker may fold
+	// into one address, so every member is compared
+	const Activation *activations[] = {&sigmoid, &relu, &leaky_relu, &tanh, &softmax, &linear};
+	for (unsigned int i = 0; i < sizeof(activations) / sizeof(activations[0]); i++)
+	{
+		if (activations[i]->function == activation.function && activations[i]->derivative == activation.derivative && activations[i]->normalize == activation.normalize)
+		{
+			return i;
+		}
+	}
+	throw std::runtime_error("Unknown activation function.");
+}
+
+Activation ActivationFunctions::fromId(unsigned int id)
+{
+	const Activation *activations[] = {&sigmoid, &relu, &leaky_relu, &tanh, &softmax, &linear};
+	if (id >= sizeof(activations) / sizeof(activations[0]))
+	{
+		throw std::runtime_error("Unknown activation identifier.");
+	}
+	return *activations[id];
+}
+
+const char *ActivationFunctions::name(const Activation &activation)
+{
+	const char *names[] = {"sigmoid", "relu", "leaky_relu", "tanh", "softmax", "linear"};
+	return names[id(activation)];
+}
+
+double softmax(double *values, size_t size)
+{
+	// Shift by the max logit so exp never overflows
+	double max = values[0];
+	for (size_t i = 1; i < size; i++)
+	{
+		max = values[i] > max ? values[i] : max;
+	}
+
+	double sum = 0.0;
+	for (size_t i = 0; i < size; i++)
+	{
+		values[i] = std::exp(values[i] - max);
+		sum += values[i];
+	}
+
+	double inverse = 1.0 / sum;
+	for (size_t i = 0; i < size; i++)
+	{
+		values[i] *= inverse;
+	}
+
+	return max + std::log(sum);
+}
+
+double softmax_cross_entropy(const double *logits, const double *probabilities, const double *targets, double log_sum_exp, double *gradient, size_t size)
+{
+	// log(p_i) = z_i - log_sum_exp, so the loss never takes the log of an underflowed probability
+	double loss = 0.0;
+	for (size_t i = 0; i < size; i++)
+	{
+		loss -= targets[i] * (logits[i] - log_sum_exp);
+		gradient[i] = probabilities[i] - targets[i];
+	}
+	return loss;
+}
@@ -2,11 +2,16 @@
 #define ACTIVATION_H
 
 #include <cmath>
+#include <cstddef> // For size_t
 
 struct Activation
 {
 	double (*function)(double);
 	double (*derivative)(double);
+
+	// Optional layer-wide normalization applied to the activated outputs in place.
+	// Returns the log of the normalizing constant. Null for element-wise activations.
+	double (*normalize)(double *values, size_t size) = nullptr;
 };
 
 class ActivationFunctions
@@ -16,7 +21,28 @@ public:
 	static Activation relu;
 	static Activation leaky_relu;
 	static Activation tanh;
+
+	// Softmax output activation, trained with the fused cross-entropy loss.
+	static Activation softmax;
+
+	// Identity activation, used by layers such as pooling that only move values.
+	static Activation linear;
+
+	// Get a stable identifier for one of the activations above, for serialization.
+	static unsigned int id(const Activation &activation);
+
+	// Get the activation for an identifier returned by id().
+	static Activation fromId(unsigned int id);
+
+	// Get the name of one of the activations above.
+	static const char *name(const Activation &activation);
 };
 
+// Numerically stable in-place softmax over logits. Returns log-sum-exp of the logits.
+double softmax(double *values, size_t size);
+
+// Fused softmax + cross-entropy kernel. Given the logits and the log-sum-exp returned by
+// softmax(), computes the cross-entropy loss and writes the gradient (p - t) in one pass.
+double softmax_cross_entropy(const double *logits, const double *probabilities, const double *targets, double log_sum_exp, double *gradient, size_t size);
 
-#endif // ACTIVATION_H
\ No newline at end of file
+#endif // ACTIVATION_H
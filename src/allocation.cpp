@@ -0,0 +1,258 @@
+#include "allocation.h"
+
+#include <cstdio>
+
+static const char *category_names[ALLOCATION_CATEGORY_COUNT] = {"other", "forward", "delta", "update", "predict"};
+
+const char *allocation_category_name(AllocationCategory category)
+{
+	return category_names[(int)category];
+}
+
+void print_allocation_stats(const char *label, const AllocationStats &stats)
+{
+	printf("%s: %lu allocations, %lu bytes, peak live %lu bytes, peak resident %ld KB\n", label, (unsigned long)stats.total_allocations, (unsigned long)stats.total_bytes, (unsigned long)stats.peak_live_bytes, stats.peak_resident_kb);
+	for (int c = 0; c < ALLOCATION_CATEGORY_COUNT; c++)
+	{
+		if (stats.allocations[c] != 0)
+		{
+			printf("  %-8s %12lu allocations %14lu bytes\n", category_names[c], (unsigned long)stats.allocations[c], (unsigned long)stats.bytes[c]);
+		}
+	}
+}
+
+#ifndef NN_TRACK_ALLOCATIONS
+
+bool allocation_tracking_enabled()
+{
+	return false;
+}
+
+#else
+
+#include <algorithm> // For max
+#include <atomic>
+#include <cstdlib>   // For malloc, free
+#include <new>
+
+#include <sys/resource.h> // For getrusage
+
+// Each block is preceded by a header holding its size, so frees can update the live byte count, and
+// the start of the underlying malloc block
+#define ALLOCATION_HEADER 16
+
+static std::atomic<uint64_t> allocation_counts[ALLOCATION_CATEGORY_COUNT];
+static std::atomic<uint64_t> allocation_bytes[ALLOCATION_CATEGORY_COUNT];
+static std::atomic<uint64_t> live_bytes;
+static std::atomic<uint64_t> peak_live_bytes;
+
+static thread_local AllocationCategory current_category = AllocationCategory::Other;
+
+static long peak_resident_kb()
+{
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+}
+
+bool allocation_tracking_enabled()
+{
+	return true;
+}
+
+// Allocate size bytes aligned to alignment, at least ALLOCATION_HEADER. The size is stored just before
+// the returned pointer and the start of the malloc block just before that.
+static void *tracked_allocate(size_t size, size_t alignment = ALLOCATION_HEADER)
+{
+	alignment = std::max<size_t>(alignment, ALLOCATION_HEADER);
+	char *base = (char *)std::malloc(size + alignment + ALLOCATION_HEADER);
+	if (!base)
+	{
+		return nullptr;
+	}
+	uintptr_t start = ((uintptr_t)base + ALLOCATION_HEADER + alignment - 1) & ~(uintptr_t)(alignment - 1);
+	char *block = (char *)start - ALLOCATION_HEADER;
+	((size_t *)block)[0] = size;
+	((char **)block)[1] = base;
+
+	int category = (int)current_category;
+	allocation_counts[category].fetch_add(1, std::memory_order_relaxed);
+	allocation_bytes[category].fetch_add(size, std::memory_order_relaxed);
+
+	uint64_t live = live_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+	uint64_t peak = peak_live_bytes.load(std::memory_order_relaxed);
+	while (live > peak && !peak_live_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+	{
+	}
+
+	return block + ALLOCATION_HEADER;
+}
+
+static void tracked_free(void *pointer)
+{
+	if (!pointer)
+	{
+		return;
+	}
+	char *block = (char *)pointer - ALLOCATION_HEADER;
+	live_bytes.fetch_sub(((size_t *)block)[0], std::memory_order_relaxed);
+	std::free(((char **)block)[1]);
+}
+
+void *operator new(size_t size)
+{
+	void *pointer = tracked_allocate(size);
+	if (!pointer)
+	{
+		throw std::bad_alloc();
+	}
+	return pointer;
+}
+
+void *operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+	return tracked_allocate(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+	return tracked_allocate(size);
+}
+
+void operator delete(void *pointer) noexcept
+{
+	tracked_free(pointer);
+}
+
+void operator delete[](void *pointer) noexcept
+{
+	tracked_free(pointer);
+}
+
+void operator delete(void *pointer, size_t) noexcept
+{
+	tracked_free(pointer);
+}
+
+void operator delete[](void *pointer, size_t) noexcept
+{
+	tracked_free(pointer);
+}
+
+void operator delete(void *pointer, const std::nothrow_t &) noexcept
+{
+	tracked_free(pointer);
+}
+
+void operator delete[](void *pointer, const std::nothrow_t &) noexcept
+{
+	tracked_free(pointer);
+}
+
+void *operator new(size_t size, std::align_val_t alignment)
+{
+	void *pointer = tracked_allocate(size, (size_t)alignment);
+	if (!pointer)
+	{
+		throw std::bad_alloc();
+	}
+	return pointer;
+}
+
+void *operator new[](size_t size, std::align_val_t alignment)
+{
+	return operator new(size, alignment);
+}
+
+void *operator new(size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+	return tracked_allocate(size, (size_t)alignment);
+}
+
+void *operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+	return tracked_allocate(size, (size_t)alignment);
+}
+
+void operator delete(void *pointer, std::align_val_t) noexcept
+{
+	tracked_free(pointer);
+}
+
+void operator delete[](void *pointer, std::align_val_t) noexcept
+{
+	tracked_free(pointer);
+}
+
+void operator delete(void *pointer, size_t, std::align_val_t) noexcept
+{
+	tracked_free(pointer);
+}
+
+void operator delete[](void *pointer, size_t, std::align_val_t) noexcept
+{
+	tracked_free(pointer);
+}
+
+void operator delete(void *pointer, std::align_val_t, const std::nothrow_t &) noexcept
+{
+	tracked_free(pointer);
+}
+
+void operator delete[](void *pointer, std::align_val_t, const std::nothrow_t &) noexcept
+{
+	tracked_free(pointer);
+}
+
+AllocationScope::AllocationScope(AllocationCategory category) : previous(current_category)
+{
+	current_category = category;
+}
+
+AllocationScope::~AllocationScope()
+{
+	current_category = this->previous;
+}
+
+// Current totals of every counter.
+static AllocationStats snapshot()
+{
+	AllocationStats stats = {};
+	for (int c = 0; c < ALLOCATION_CATEGORY_COUNT; c++)
+	{
+		stats.allocations[c] = allocation_counts[c].load(std::memory_order_relaxed);
+		stats.bytes[c] = allocation_bytes[c].load(std::memory_order_relaxed);
+	}
+	stats.peak_live_bytes = peak_live_bytes.load(std::memory_order_relaxed);
+	stats.peak_resident_kb = peak_resident_kb();
+	return stats;
+}
+
+AllocationCounter::AllocationCounter()
+{
+	peak_live_bytes.store(live_bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	this->start = snapshot();
+}
+
+AllocationStats AllocationCounter::stats() const
+{
+	AllocationStats now = snapshot();
+	AllocationStats stats = now;
+	stats.total_allocations = 0;
+	stats.total_bytes = 0;
+	for (int c = 0; c < ALLOCATION_CATEGORY_COUNT; c++)
+	{
+		stats.allocations[c] = now.allocations[c] - this->start.allocations[c];
+		stats.bytes[c] = now.bytes[c] - this->start.bytes[c];
+		stats.total_allocations += stats.allocations[c];
+		stats.total_bytes += stats.bytes[c];
+	}
+	return stats;
+}
+
+#endif // NN_TRACK_ALLOCATIONS
@@ -0,0 +1,88 @@
+#ifndef ALLOCATION_H
+#define ALLOCATION_H
+
+#include <stdint.h> // For uint64_t
+
+// Heap allocation accounting. Compile with -DNN_TRACK_ALLOCATIONS to replace the global operator
+// new/delete with counting versions. Without it every type below is an empty, zero-cost stub and
+// all counts read as zero.
+
+// Call site categories that allocations are attributed to.
+enum class AllocationCategory
+{
+	Other,   // Anything outside the categories below.
+	Forward, // Forward pass during training.
+	Delta,   // Delta computation.
+	Update,  // Weight and bias updates.
+	Predict, // Inference through Network::predict.
+};
+
+#define ALLOCATION_CATEGORY_COUNT 5
+
+// Allocation counts since a starting point.
+struct AllocationStats
+{
+	uint64_t allocations[ALLOCATION_CATEGORY_COUNT]; // Allocations per category.
+	uint64_t bytes[ALLOCATION_CATEGORY_COUNT];       // Bytes allocated per category.
+	uint64_t total_allocations;                      // Allocations in all categories.
+	uint64_t total_bytes;                            // Bytes allocated in all categories.
+	uint64_t peak_live_bytes;                        // Highest number of live heap bytes.
+	long peak_resident_kb;                           // Peak resident set size of the process.
+};
+
+// Check whether allocation tracking is compiled in.
+bool allocation_tracking_enabled();
+
+// Get the name of a category.
+const char *allocation_category_name(AllocationCategory category);
+
+// Print allocation statistics with a label.
+void print_allocation_stats(const char *label, const AllocationStats &stats);
+
+#ifdef NN_TRACK_ALLOCATIONS
+
+// Attributes this thread's allocations to a category until the scope ends.
+class AllocationScope
+{
+public:
+	AllocationScope(AllocationCategory category);
+	~AllocationScope();
+
+private:
+	AllocationCategory previous; // Category restored at the end of the scope.
+};
+
+// Measures allocations from construction until stats() is called. Starting a counter resets the
+// process-wide live byte peak, so only one counter should be active at a time.
+class AllocationCounter
+{
+public:
+	AllocationCounter();
+
+	// Get the allocations since construction.
+	AllocationStats stats() const;
+
+private:
+	AllocationStats start; // Totals at construction.
+};
+
+#else
+
+class AllocationScope
+{
+public:
+	AllocationScope(AllocationCategory) {}
+};
+
+class AllocationCounter
+{
+public:
+	AllocationStats stats() const
+	{
+		return AllocationStats();
+	}
+};
+
+#endif // NN_TRACK_ALLOCATIONS
+
+#endif // ALLOCATION_H
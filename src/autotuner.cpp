@@ -0,0 +1,192 @@
+#include "autotuner.h"
+#include "random.h"
+
+#include <algorithm> // For min
+#include <chrono>    // For steady_clock
+#include <cstdio>    // For rename, remove
+#include <fstream>
+#include <sstream>   // For istringstream
+#include <thread>
+
+#include <unistd.h>  // For getpid
+
+// Minimum measuring time and repetitions per candidate
+#define TUNE_MIN_SECONDS 0.002
+#define TUNE_MIN_REPETITIONS 3
+
+Autotuner::Autotuner(const std::string &cache_path) : cache_path(cache_path), cpu(cpuModel())
+{
+	std::ifstream file(cache_path);
+	std::string line;
+	while (std::getline(file, line))
+	{
+		std::istringstream fields(line);
+		std::string cpu, kernel_name;
+		unsigned int rows, cols, batch, num_threads;
+		double seconds;
+
+		if (!std::getline(fields, cpu, '\t') || !(fields >> rows >> cols >> batch >> kernel_name >> num_threads >> seconds))
+		{
+			continue;
+		}
+
+		if (cpu != this->cpu)
+		{
+			this->other_lines.push_back(line);
+			continue;
+		}
+
+		// Kernels can disappear between builds, such entries are simply tuned again
+		const DenseKernel *kernel = find_dense_kernel(kernel_name);
+		if (kernel)
+		{
+			this->choices[Shape(rows, cols, batch)] = {kernel, num_threads, seconds};
+		}
+	}
+}
+
+std::string Autotuner::cpuModel()
+{
+	std::ifstream file("/proc/cpuinfo");
+	std::string line;
+	while (std::getline(file, line))
+	{
+		if (line.rfind("model name", 0) == 0)
+		{
+			size_t colon = line.find(':');
+			return colon == std::string::npos ? line : line.substr(line.find_first_not_of(' ', colon + 1));
+		}
+	}
+	return "unknown";
+}
+
+unsigned int Autotuner::batchBucket(unsigned int batch)
+{
+	unsigned int bucket = 1;
+	while (bucket < batch)
+	{
+		bucket <<= 1;
+	}
+	return bucket;
+}
+
+KernelChoice Autotuner::tune(unsigned int rows, unsigned int cols, unsigned int batch)
+{
+	// Random operands so timings are not skewed by denormals or zeros
+	std::vector<double> weights((size_t)rows * cols);
+	std::vector<double> biases(rows);
+	std::vector<double> inputs((size_t)batch * cols);
+	std::vector<double> outputs((size_t)batch * rows);
+	for (size_t i = 0; i < weights.size(); i++)
+	{
+		weights[i] = 2 * random_uniform(0, 0, i) - 1;
+	}
+	for (size_t i = 0; i < inputs.size(); i++)
+	{
+		inputs[i] = random_uniform(0, 1, i);
+	}
+
+	std::vector<unsigned int> thread_counts = {1};
+	unsigned int hardware_threads = std::max(1u, std::thread::hardware_concurrency());
+	for (unsigned int threads = 2; threads < hardware_threads; threads *= 2)
+	{
+		thread_counts.push_back(threads);
+	}
+	if (hardware_threads > 1)
+	{
+		thread_counts.push_back(hardware_threads);
+	}
+
+	KernelChoice best = {&dense_kernels()[0], 1, 1e30};
+	for (const DenseKernel &kernel : dense_kernels())
+	{
+		for (unsigned int threads : thread_counts)
+		{
+			if (threads > rows)
+			{
+				continue;
+			}
+
+			// Warm up caches, then keep the fastest of the timed repetitions
+			run_dense_kernel(kernel, weights.data(), biases.data(), inputs.data(), outputs.data(), rows, cols, batch, threads);
+
+			double fastest = 1e30;
+			double total = 0.0;
+			for (int repetition = 0; repetition < TUNE_MIN_REPETITIONS || total < TUNE_MIN_SECONDS; repetition++)
+			{
+				std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+				run_dense_kernel(kernel, weights.data(), biases.data(), inputs.data(), outputs.data(), rows, cols, batch, threads);
+				double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+				fastest = std::min(fastest, seconds);
+				total += seconds;
+			}
+
+			if (fastest < best.seconds)
+			{
+				best = {&kernel, threads, fastest};
+			}
+		}
+	}
+	return best;
+}
+
+KernelChoice Autotuner::select(unsigned int rows, unsigned int cols, unsigned int batch)
+{
+	Shape shape(rows, cols, batchBucket(batch));
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		std::map<Shape, KernelChoice>::iterator choice = this->choices.find(shape);
+		if (choice != this->choices.end())
+		{
+			return choice->second;
+		}
+	}
+
+	// Benchmark outside the lock, a concurrent tune of the same shape just does the work twice
+	KernelChoice choice = tune(rows, cols, std::get<2>(shape));
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->choices[shape] = choice;
+	}
+	this->save();
+	return choice;
+}
+
+void Autotuner::save()
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+
+	// Write a private temporary file and rename it over the cache, so readers and concurrent
+	// writers never see a truncated cache
+	std::string temporary_path = this->cache_path + ".tmp." + std::to_string(getpid());
+	{
+		std::ofstream file(temporary_path);
+		if (!file.is_open())
+		{
+			return;
+		}
+
+		for (const std::string &line : this->other_lines)
+		{
+			file << line << "\n";
+		}
+		for (const std::pair<const Shape, KernelChoice> &entry : this->choices)
+		{
+			file << this->cpu << "\t" << std::get<0>(entry.first) << "\t" << std::get<1>(entry.first) << "\t" << std::get<2>(entry.first) << "\t"
+				 << entry.second.kernel->name << "\t" << entry.second.num_threads << "\t" << entry.second.seconds << "\n";
+		}
+
+		if (!file.flush())
+		{
+			file.close();
+			std::remove(temporary_path.c_str());
+			return;
+		}
+	}
+
+	if (std::rename(temporary_path.c_str(), this->cache_path.c_str()) != 0)
+	{
+		std::remove(temporary_path.c_str());
+	}
+}
@@ -0,0 +1,56 @@
+#ifndef AUTOTUNER_H
+#define AUTOTUNER_H
+
+#include "kernels.h"
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#define AUTOTUNER_DEFAULT_CACHE "tuning-cache.tsv"
+
+// Tuned kernel configuration for one layer shape and batch size.
+struct KernelChoice
+{
+	const DenseKernel *kernel; // Fastest kernel.
+	unsigned int num_threads;  // Fastest thread count.
+	double seconds;            // Measured time per call.
+};
+
+// Picks the fastest dense kernel and thread count for each layer shape and batch size by
+// benchmarking the candidates, and persists the decisions to a cache file keyed by CPU model.
+class Autotuner
+{
+public:
+	// Load previous decisions for this CPU from the cache file, if it exists.
+	Autotuner(const std::string &cache_path = AUTOTUNER_DEFAULT_CACHE);
+
+	// Get the choice for a shape and batch size, benchmarking and caching it on first use. Thread-safe.
+	KernelChoice select(unsigned int rows, unsigned int cols, unsigned int batch);
+
+	// Benchmark every candidate kernel and thread count for a shape and batch size.
+	static KernelChoice tune(unsigned int rows, unsigned int cols, unsigned int batch);
+
+	// Write the decisions to the cache file, keeping entries of other CPUs. The file is replaced
+	// atomically, so a failed write leaves the previous cache intact.
+	void save();
+
+	// Get the CPU model name used to key the cache.
+	static std::string cpuModel();
+
+private:
+	typedef std::tuple<unsigned int, unsigned int, unsigned int> Shape; // Rows, columns and batch size.
+
+	std::string cache_path;               // Path of the cache file.
+	std::string cpu;                      // CPU model of this machine.
+	std::map<Shape, KernelChoice> choices; // Decisions for this CPU.
+	std::vector<std::string> other_lines; // Cache entries of other CPUs, kept on save.
+	std::mutex mutex;                     // Guards choices.
+
+	// Round a batch size up to the power of two it is tuned under.
+	static unsigned int batchBucket(unsigned int batch);
+};
+
+#endif // AUTOTUNER_H
@@ -0,0 +1,219 @@
+#include "cascade.h"
+#include "evaluation.h"
+
+#include <cstdio>
+#include <cmath>     // For INFINITY
+#include <algorithm> // For sort
+#include <stdexcept> // For runtime_error
+
+Cascade::Cascade(ExitCriterion criterion) : criterion(criterion)
+{
+	// Constructor, if necessary
+}
+
+Cascade* Cascade::addStage(const Network &network, double threshold)
+{
+	if (network.size() == 0)
+	{
+		throw std::runtime_error("Cascade stages must have at least one layer.");
+	}
+
+	unsigned int output_size = network.getLayer(network.size() - 1).size();
+	if (!this->stages.empty() && (network.inputSize() != this->stages[0].inputSize() || output_size != this->stages[0].getLayer(this->stages[0].size() - 1).size()))
+	{
+		throw std::runtime_error("Cascade stages must have the same input and output sizes.");
+	}
+
+	size_t cost = 0;
+	for (unsigned int l = 0; l < network.size(); l++)
+	{
+		cost += network.getLayer(l).getWeights().size();
+	}
+
+	this->stages.push_back(network);
+	this->thresholds.push_back(threshold);
+	this->costs.push_back(cost);
+
+	return this;
+}
+
+unsigned int Cascade::size() const
+{
+	return this->stages.size();
+}
+
+double Cascade::getThreshold(unsigned int stage) const
+{
+	return this->thresholds.at(stage);
+}
+
+void Cascade::setThreshold(unsigned int stage, double threshold)
+{
+	this->thresholds.at(stage) = threshold;
+}
+
+double Cascade::confidence(const std::vector<double> &output) const
+{
+	double first = -INFINITY;
+	double second = -INFINITY;
+	for (double value : output)
+	{
+		if (value > first)
+		{
+			second = first;
+			first = value;
+		}
+		else if (value > second)
+		{
+			second = value;
+		}
+	}
+
+	if (this->criterion == ExitCriterion::Margin && output.size() > 1)
+	{
+		return first - second;
+	}
+	return first;
+}
+
+unsigned int Cascade::predict(std::span<const double> input, std::vector<double> &output) const
+{
+	if (this->stages.empty())
+	{
+		throw std::runtime_error("Cascade has no stages.");
+	}
+
+	unsigned int last = this->stages.size() - 1;
+	for (unsigned int s = 0; s < last; s++)
+	{
+		this->stages[s].predict(input, output);
+		if (this->confidence(output) >= this->thresholds[s])
+		{
+			return s;
+		}
+	}
+
+	this->stages[last].predict(input, output);
+	return last;
+}
+
+CascadeReport Cascade::calibrate(const Dataset &validation, double target_accuracy)
+{
+	if (validation.inputs.size() != validation.targets.size())
+	{
+		throw std::runtime_error("Input and target data have different sizes.");
+	}
+	if (validation.size() == 0 || this->stages.empty())
+	{
+		throw std::runtime_error("Cannot calibrate an empty cascade or dataset.");
+	}
+
+	size_t num_samples = validation.size();
+	unsigned int last = this->stages.size() - 1;
+
+	// Confidence and correctness of every stage on every sample
+	std::vector<std::vector<double>> confidences(this->stages.size(), std::vector<double>(num_samples));
+	std::vector<std::vector<char>> correct(this->stages.size(), std::vector<char>(num_samples));
+
+	std::vector<double> output;
+	for (unsigned int s = 0; s < this->stages.size(); s++)
+	{
+		for (size_t i = 0; i < num_samples; i++)
+		{
+			this->stages[s].predict(validation.inputs[i], output);
+			confidences[s][i] = this->confidence(output);
+			correct[s][i] = argmax(output) == argmax(validation.targets[i]);
+		}
+	}
+
+	// Each stage is calibrated assuming the samples it passes on are answered by the last stage.
+	// Later stages keep that accuracy or better, since never exiting reproduces the assumption.
+	std::vector<size_t> remaining(num_samples);
+	for (size_t i = 0; i < num_samples; i++)
+	{
+		remaining[i] = i;
+	}
+	size_t correct_before = 0;
+
+	for (unsigned int s = 0; s < last; s++)
+	{
+		std::sort(remaining.begin(), remaining.end(), [&](size_t a, size_t b) { return confidences[s][a] > confidences[s][b]; });
+
+		long running = correct_before;
+		for (size_t i : remaining)
+		{
+			running += correct[last][i];
+		}
+
+		// Exit the k most confident samples, only cutting between distinct confidences
+		size_t best_exits = 0;
+		for (size_t k = 1; k <= remaining.size(); k++)
+		{
+			size_t i = remaining[k - 1];
+			running += correct[s][i] - correct[last][i];
+
+			bool boundary = k == remaining.size() || confidences[s][remaining[k]] != confidences[s][i];
+			if (boundary && (double)running / num_samples >= target_accuracy)
+			{
+				best_exits = k;
+			}
+		}
+
+		this->thresholds[s] = best_exits == 0 ? INFINITY : confidences[s][remaining[best_exits - 1]];
+		for (size_t k = 0; k < best_exits; k++)
+		{
+			correct_before += correct[s][remaining[k]];
+		}
+		remaining.erase(remaining.begin(), remaining.begin() + best_exits);
+	}
+
+	return this->evaluate(validation);
+}
+
+CascadeReport Cascade::evaluate(const Dataset &dataset) const
+{
+	if (dataset.inputs.size() != dataset.targets.size())
+	{
+		throw std::runtime_error("Input and target data have different sizes.");
+	}
+	if (dataset.size() == 0 || this->stages.empty())
+	{
+		throw std::runtime_error("Cannot evaluate an empty cascade or dataset.");
+	}
+
+	CascadeReport report;
+	report.samples = dataset.size();
+	report.correct = 0;
+	report.exits.assign(this->stages.size(), 0);
+
+	// Every stage up to the answering one was evaluated
+	double cost = 0.0;
+	std::vector<double> output;
+	for (size_t i = 0; i < dataset.size(); i++)
+	{
+		unsigned int stage = this->predict(dataset.inputs[i], output);
+		report.exits[stage]++;
+		report.correct += argmax(output) == argmax(dataset.targets[i]);
+		for (unsigned int s = 0; s <= stage; s++)
+		{
+			cost += this->costs[s];
+		}
+	}
+
+	report.accuracy = (double)report.correct / report.samples;
+	report.relative_cost = cost / ((double)report.samples * this->costs.back());
+
+	return report;
+}
+
+void print_cascade_report(const CascadeReport &report)
+{
+	printf("Accuracy: %.2f%% (%zu/%zu) - Relative cost: %.2f\n\n", report.accuracy * 100, report.correct, report.samples, report.relative_cost);
+
+	printf("Stage  Exits   Share\n");
+	for (size_t s = 0; s < report.exits.size(); s++)
+	{
+		printf("%-6zu %-7zu %5.1f%%\n", s, report.exits[s], 100.0 * report.exits[s] / report.samples);
+	}
+	printf("\n");
+}
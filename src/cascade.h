@@ -0,0 +1,75 @@
+#ifndef CASCADE_H
+#define CASCADE_H
+
+#include "network.h"
+#include "dataset.h"
+
+#include <vector>
+#include <span>
+
+// Confidence measure deciding whether a cascade stage answers.
+enum class ExitCriterion
+{
+	MaxProbability, // Largest output.
+	Margin,         // Difference between the two largest outputs.
+};
+
+// Results of running a cascade over a labeled dataset.
+struct CascadeReport
+{
+	size_t samples;            // Number of samples scored.
+	size_t correct;            // Number of samples whose answer matches the label.
+	double accuracy;           // Fraction of samples answered correctly.
+	std::vector<size_t> exits; // Number of samples answered by each stage.
+	double relative_cost;      // Mean weights evaluated per sample, relative to the last stage alone.
+};
+
+// Early-exit inference across models of increasing size. Each input runs through the cheapest model
+// first and only escalates to the next one while the output confidence is below the stage threshold.
+// The last stage always answers.
+class Cascade
+{
+public:
+	Cascade(ExitCriterion criterion = ExitCriterion::MaxProbability);
+
+	// Add a copy of a model as the next stage, cheapest first. Inputs escalate when the confidence
+	// is below threshold. Every stage must have the same input and output sizes.
+	Cascade* addStage(const Network &network, double threshold = 1.0);
+
+	// Get the number of stages.
+	unsigned int size() const;
+
+	// Get the exit threshold of a stage.
+	double getThreshold(unsigned int stage) const;
+
+	// Set the exit threshold of a stage.
+	void setThreshold(unsigned int stage, double threshold);
+
+	// Get the confidence of an output under the exit criterion.
+	double confidence(const std::vector<double> &output) const;
+
+	// Make a prediction, writing the answering stage's output. Returns the index of that stage.
+	// Safe to call concurrently from multiple threads.
+	unsigned int predict(std::span<const double> input, std::vector<double> &output) const;
+
+	// Pick the lowest thresholds that keep the cascade's validation accuracy at or above the target,
+	// front to back, and return the calibrated cascade's results on the validation set. Each stage
+	// is judged with the inputs it passes on answered by the last stage. A stage whose exits cannot
+	// reach the target that way gets an infinite threshold and passes everything on, so every input
+	// reaches the last stage only when no stage's exits reach the target.
+	CascadeReport calibrate(const Dataset &validation, double target_accuracy);
+
+	// Score the cascade on a labeled dataset. Labels are the argmax of each target vector.
+	CascadeReport evaluate(const Dataset &dataset) const;
+
+private:
+	ExitCriterion criterion;        // Confidence measure used by every stage.
+	std::vector<Network> stages;    // Models, cheapest first.
+	std::vector<double> thresholds; // Exit threshold of each stage.
+	std::vector<size_t> costs;      // Number of weights of each stage.
+};
+
+// Print a cascade report to the console.
+void print_cascade_report(const CascadeReport &report);
+
+#endif // CASCADE_H
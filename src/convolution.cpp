@@ -0,0 +1,170 @@
+#include "convolution.h"
+
+#include <algorithm> // For fill, min, max
+
+unsigned int Conv2D::outputHeight() const
+{
+	return (this->height + 2 * this->padding - this->kernel) / this->stride + 1;
+}
+
+unsigned int Conv2D::outputWidth() const
+{
+	return (this->width + 2 * this->padding - this->kernel) / this->stride + 1;
+}
+
+unsigned int MaxPool2D::outputHeight() const
+{
+	return (this->height - this->size) / this->stride + 1;
+}
+
+unsigned int MaxPool2D::outputWidth() const
+{
+	return (this->width - this->size) / this->stride + 1;
+}
+
+void im2col(const Conv2D &shape, const double *input, double *columns)
+{
+	unsigned int output_height = shape.outputHeight();
+	unsigned int output_width = shape.outputWidth();
+	size_t patch_size = (size_t)shape.channels * shape.kernel * shape.kernel;
+
+	for (unsigned int oy = 0; oy < output_height; oy++)
+	{
+		for (unsigned int ox = 0; ox < output_width; ox++)
+		{
+			double *patch = columns + ((size_t)oy * output_width + ox) * patch_size;
+			for (unsigned int c = 0; c < shape.channels; c++)
+			{
+				const double *channel = input + (size_t)c * shape.height * shape.width;
+				for (unsigned int ky = 0; ky < shape.kernel; ky++)
+				{
+					// Signed, since padding moves the patch above and left of the input
+					int iy = (int)(oy * shape.stride + ky) - (int)shape.padding;
+					for (unsigned int kx = 0; kx < shape.kernel; kx++)
+					{
+						int ix = (int)(ox * shape.stride + kx) - (int)shape.padding;
+						bool inside = iy >= 0 && iy < (int)shape.height && ix >= 0 && ix < (int)shape.width;
+						*patch++ = inside ? channel[(size_t)iy * shape.width + ix] : 0.0;
+					}
+				}
+			}
+		}
+	}
+}
+
+void col2im(const Conv2D &shape, const double *columns, double *input)
+{
+	unsigned int output_height = shape.outputHeight();
+	unsigned int output_width = shape.outputWidth();
+	size_t patch_size = (size_t)shape.channels * shape.kernel * shape.kernel;
+
+	for (unsigned int oy = 0; oy < output_height; oy++)
+	{
+		for (unsigned int ox = 0; ox < output_width; ox++)
+		{
+			const double *patch = columns + ((size_t)oy * output_width + ox) * patch_size;
+			for (unsigned int c = 0; c < shape.channels; c++)
+			{
+				double *channel = input + (size_t)c * shape.height * shape.width;
+				for (unsigned int ky = 0; ky < shape.kernel; ky++)
+				{
+					int iy = (int)(oy * shape.stride + ky) - (int)shape.padding;
+					for (unsigned int kx = 0; kx < shape.kernel; kx++)
+					{
+						int ix = (int)(ox * shape.stride + kx) - (int)shape.padding;
+						if (iy >= 0 && iy < (int)shape.height && ix >= 0 && ix < (int)shape.width)
+						{
+							channel[(size_t)iy * shape.width + ix] += *patch;
+						}
+						patch++;
+					}
+				}
+			}
+		}
+	}
+}
+
+void convolve_3x3(const Conv2D &shape, const double *weights, const double *input, double *output)
+{
+	int output_height = shape.outputHeight();
+	int output_width = shape.outputWidth();
+	int padding = shape.padding;
+	size_t positions = (size_t)output_height * output_width;
+
+	for (unsigned int f = 0; f < shape.filters; f++)
+	{
+		double *plane = output + f * positions;
+		std::fill(plane, plane + positions, 0.0);
+
+		for (unsigned int c = 0; c < shape.channels; c++)
+		{
+			const double *channel = input + (size_t)c * shape.height * shape.width;
+			const double *taps = weights + ((size_t)f * shape.channels + c) * 9;
+
+			for (int ky = 0; ky < 3; ky++)
+			{
+				for (int kx = 0; kx < 3; kx++)
+				{
+					double weight = taps[ky * 3 + kx];
+
+					// Output columns whose input column ox + kx - padding is inside the row
+					int ox_begin = std::max(0, padding - kx);
+					int ox_end = std::min(output_width, (int)shape.width + padding - kx);
+
+					for (int oy = 0; oy < output_height; oy++)
+					{
+						int iy = oy + ky - padding;
+						if (iy < 0 || iy >= (int)shape.height)
+						{
+							continue;
+						}
+
+						const double *source = channel + (size_t)iy * shape.width;
+						double *target = plane + (size_t)oy * output_width;
+						for (int ox = ox_begin; ox < ox_end; ox++)
+						{
+							target[ox] += weight * source[ox + kx - padding];
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+void max_pool(const MaxPool2D &shape, const double *input, double *output, unsigned int *switches)
+{
+	unsigned int output_height = shape.outputHeight();
+	unsigned int output_width = shape.outputWidth();
+
+	for (unsigned int c = 0; c < shape.channels; c++)
+	{
+		size_t channel = (size_t)c * shape.height * shape.width;
+		for (unsigned int oy = 0; oy < output_height; oy++)
+		{
+			for (unsigned int ox = 0; ox < output_width; ox++)
+			{
+				// The first maximum of the window wins ties
+				size_t best = channel + (size_t)oy * shape.stride * shape.width + ox * shape.stride;
+				for (unsigned int ky = 0; ky < shape.size; ky++)
+				{
+					size_t row = channel + (size_t)(oy * shape.stride + ky) * shape.width + ox * shape.stride;
+					for (unsigned int kx = 0; kx < shape.size; kx++)
+					{
+						if (input[row + kx] > input[best])
+						{
+							best = row + kx;
+						}
+					}
+				}
+
+				size_t o = ((size_t)c * output_height + oy) * output_width + ox;
+				output[o] = input[best];
+				if (switches)
+				{
+					switches[o] = best;
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,64 @@
+#ifndef CONVOLUTION_H
+#define CONVOLUTION_H
+
+// Kind of computation a layer performs.
+enum class LayerType
+{
+	Dense,     // Fully connected.
+	Conv2D,    // 2D convolution.
+	MaxPool2D, // 2D max pooling.
+};
+
+// Shape of a 2D convolution. Inputs and outputs are laid out channel by channel, each channel row
+// by row (CHW), and filter weights as channels x kernel x kernel per filter.
+struct Conv2D
+{
+	unsigned int channels;    // Input channels.
+	unsigned int height;      // Input height.
+	unsigned int width;       // Input width.
+	unsigned int filters;     // Output channels.
+	unsigned int kernel;      // Side of the square kernel.
+	unsigned int stride = 1;  // Step between neighbouring outputs.
+	unsigned int padding = 0; // Zeros added on every side of the input.
+
+	// Get the output height.
+	unsigned int outputHeight() const;
+
+	// Get the output width.
+	unsigned int outputWidth() const;
+};
+
+// Shape of a 2D max pooling over CHW inputs. Every channel is pooled on its own.
+struct MaxPool2D
+{
+	unsigned int channels;   // Input channels.
+	unsigned int height;     // Input height.
+	unsigned int width;      // Input width.
+	unsigned int size = 2;   // Side of the square window.
+	unsigned int stride = 2; // Step between neighbouring windows.
+
+	// Get the output height.
+	unsigned int outputHeight() const;
+
+	// Get the output width.
+	unsigned int outputWidth() const;
+};
+
+// Unfold one input into a matrix of outputHeight() * outputWidth() rows, one per output position,
+// of channels * kernel * kernel values, in filter weight order. Padding reads as zero.
+void im2col(const Conv2D &shape, const double *input, double *columns);
+
+// Add a matrix laid out as by im2col back onto the input positions it was read from, so values of
+// overlapping patches are summed. Padding positions are dropped.
+void col2im(const Conv2D &shape, const double *columns, double *input);
+
+// Direct convolution for 3x3 kernels with stride 1: output[f][p] = sum of the filter's weights times
+// the input patch of p, without biases. Each filter tap is applied across whole output rows, so the
+// inner loop is a contiguous multiply-add.
+void convolve_3x3(const Conv2D &shape, const double *weights, const double *input, double *output);
+
+// Max pooling of one input. switches receives the input index of each output's maximum, or may be
+// nullptr when no backward pass follows.
+void max_pool(const MaxPool2D &shape, const double *input, double *output, unsigned int *switches);
+
+#endif // CONVOLUTION_H
@@ -6,6 +6,10 @@
 #include <string>
 #include <sstream>   // For stringstream
 #include <stdexcept> // For runtime_error
+#include <span>
+#include <cctype>    // For isdigit
+#include <cstdlib>   // For strtod
+#include <algorithm> // For copy
 
 uint8_t **read_mnist_images(std::string full_path, int number_of_images, int image_size)
 {
@@ -83,6 +87,41 @@ uint8_t *read_mnist_labels(std::string full_path, int number_of_labels)
 	}
 }
 
+Dataset load_mnist(std::string images_path, std::string labels_path, int number_of_images)
+{
+	uint8_t **images = read_mnist_images(images_path, number_of_images, 784);
+	uint8_t *labels = read_mnist_labels(labels_path, number_of_images);
+
+	Dataset dataset;
+	dataset.inputs.reserve(number_of_images);
+	dataset.targets.reserve(number_of_images);
+
+	// Convert data to vectors
+	for (int i = 0; i < number_of_images; i++)
+	{
+		std::vector<double> input(784);
+		for (int j = 0; j < 784; j++)
+		{
+			input[j] = images[i][j] / 255.0;
+		}
+		dataset.inputs.emplace_back(std::move(input));
+
+		std::vector<double> target(10, 0.0);
+		target[labels[i]] = 1.0;
+		dataset.targets.emplace_back(std::move(target));
+	}
+
+	// Free memory
+	for (int i = 0; i < number_of_images; i++)
+	{
+		delete[] images[i];
+	}
+	delete[] images;
+	delete[] labels;
+
+	return dataset;
+}
+
 void print_image(std::vector<double> image, int width, int height)
 {
 	std::string edges[8] = {"┌", "┐", "└", "┘", "─", "─", "│", "│"};
@@ -114,162 +153,191 @@ void print_image(std::vector<double> image, int width, int height)
 	std::cout << edges[3] << std::endl;
 }
 
-void export_network(Network network, std::string filename)
+bool export_network(const Network &network, const std::string &filename)
 {
-	std::pair<std::vector<std::vector<double>>, std::vector<std::vector<std::vector<double>>>> weights_biases = network.exportWeightsBiases();
-
-	std::vector<std::vector<double>> bias = weights_biases.first;
-	std::vector<std::vector<std::vector<double>>> weights = weights_biases.second;
+	std::ofstream file(filename);
+	if (!file.is_open())
+	{
+		std::cout << "Unable to open file `" << filename << "`!" << std::endl;
+		return false;
+	}
 
-	// Create a JSON object to store the weights and biases
-	std::string json = "{\n";
-	json += "\"weights\": [\n";
+	// Write a JSON object with the weights and biases of each layer
+	file << "{\n";
+	file << "\"weights\": [\n";
 
 	// Add the weights to the JSON object
-	for (int i = 0; i < weights.size(); i++)
+	for (unsigned int l = 0; l < network.size(); l++)
 	{
-		json += "[\n";
-		for (int j = 0; j < weights[i].size(); j++)
+		const Layer &layer = network.getLayer(l);
+
+		file << "[\n";
+		for (unsigned int i = 0; i < layer.weightRows(); i++)
 		{
-			json += "[";
-			for (int k = 0; k < weights[i][j].size(); k++)
+			std::span<const double> row = layer.getWeights(i);
+
+			file << "[";
+			for (size_t j = 0; j < row.size(); j++)
 			{
-				json += std::to_string(weights[i][j][k]);
-				if (k != weights[i][j].size() - 1)
+				file << std::to_string(row[j]);
+				if (j != row.size() - 1)
 				{
-					json += ",";
+					file << ",";
 				}
 			}
-			json += "]";
-			if (j != weights[i].size() - 1)
+			file << "]";
+			if (i != layer.weightRows() - 1)
 			{
-				json += ",";
+				file << ",";
 			}
-			json += "\n";
+			file << "\n";
 		}
-		json += "]";
-		if (i != weights.size() - 1)
+		file << "]";
+		if (l != network.size() - 1)
 		{
-			json += ",";
+			file << ",";
 		}
-		json += "\n";
+		file << "\n";
 	}
 
-	json += "],\n";
-	json += "\"biases\": [\n";
+	file << "],\n";
+	file << "\"biases\": [\n";
 
 	// Add the biases to the JSON object
-	for (int i = 0; i < bias.size(); i++)
+	for (unsigned int l = 0; l < network.size(); l++)
 	{
-		json += "[";
-		for (int j = 0; j < bias[i].size(); j++)
+		std::span<const double> biases = network.getLayer(l).getBiases();
+
+		file << "[";
+		for (size_t i = 0; i < biases.size(); i++)
 		{
-			json += std::to_string(bias[i][j]);
-			if (j != bias[i].size() - 1)
+			file << std::to_string(biases[i]);
+			if (i != biases.size() - 1)
 			{
-				json += ",";
+				file << ",";
 			}
 		}
-		json += "]";
-		if (i != bias.size() - 1)
+		file << "]";
+		if (l != network.size() - 1)
 		{
-			json += ",";
+			file << ",";
 		}
-		json += "\n";
+		file << "\n";
 	}
 
-	json += "]\n";
-	json += "}\n";
+	file << "]\n";
+	file << "}\n";
 
-	// Write the JSON object to a file
-	std::ofstream file(filename);
-	if (file.is_open())
+	file.close();
+	if (file.fail())
 	{
-		file << json;
-		file.close();
+		std::cout << "Unable to write file `" << filename << "`!" << std::endl;
+		return false;
 	}
-	else
+	return true;
+}
+
+// Helper function to parse the next number before end into value, returns false if there is none
+static bool next_number(const char *&cursor, const char *end, double &value)
+{
+	while (cursor < end && !(std::isdigit((unsigned char)*cursor) || *cursor == '-' || *cursor == '+' || *cursor == '.'))
 	{
-		std::cout << "Unable to open file `" << filename << "`!" << std::endl;
+		cursor++;
+	}
+	if (cursor >= end)
+	{
+		return false;
 	}
+
+	char *parsed;
+	value = std::strtod(cursor, &parsed);
+	if (parsed == cursor || parsed > end)
+	{
+		throw std::runtime_error("Invalid number in network file.");
+	}
+	cursor = parsed;
+	return true;
 }
 
-// Helper function to split a string by a delimiter
-std::vector<std::string> split(const std::string &str, char delimiter)
+// Helper function to fill values with the numbers of a section, which must hold exactly that many
+static void parse_section(const char *begin, const char *end, const std::vector<std::span<double>> &values)
 {
-	std::vector<std::string> tokens;
-	std::stringstream ss(str);
-	std::string token;
-	while (std::getline(ss, token, delimiter))
+	const char *cursor = begin;
+	for (std::span<double> layer_values : values)
+	{
+		for (double &value : layer_values)
+		{
+			if (!next_number(cursor, end, value))
+			{
+				throw std::runtime_error("Network file does not match the network shape.");
+			}
+		}
+	}
+
+	double extra;
+	if (next_number(cursor, end, extra))
 	{
-		tokens.push_back(token);
+		throw std::runtime_error("Network file does not match the network shape.");
 	}
-	return tokens;
 }
 
-void import_network(Network &network, std::string filename)
+void import_network(Network &network, const std::string &filename)
 {
 	// Read the JSON file
 	std::ifstream file(filename);
-	std::string json_string;
-	file >> json_string;
-	file.close();
+	if (!file.is_open())
+	{
+		throw std::runtime_error("Unable to open file `" + filename + "`.");
+	}
+	std::stringstream buffer;
+	buffer << file.rdbuf();
+	std::string json_string = buffer.str();
+
+	size_t weights_pos = json_string.find("\"weights\"");
+	size_t biases_pos = json_string.find("\"biases\"");
+	if (weights_pos == std::string::npos || biases_pos == std::string::npos)
+	{
+		throw std::runtime_error("Network file is missing weights or biases.");
+	}
 
-	// Parse the JSON string
-	std::vector<std::vector<double>> biases;
-	std::vector<std::vector<std::vector<double>>> weights;
+	// Each section runs until the start of the other one or the end of the file
+	const char *json = json_string.c_str();
+	const char *weights_end = json + (weights_pos < biases_pos ? biases_pos : json_string.size());
+	const char *biases_end = json + (biases_pos < weights_pos ? weights_pos : json_string.size());
 
-	// Extract biases
-	size_t pos = json_string.find("\"biases\": [");
-	if (pos != std::string::npos)
+	// Parse into a scratch copy laid out like the layers, so a malformed file leaves the network untouched
+	size_t num_weights = 0;
+	size_t num_biases = 0;
+	for (unsigned int l = 0; l < network.size(); l++)
 	{
-		pos += 11;
-		size_t end_pos = json_string.find("]", pos);
-		if (end_pos != std::string::npos)
-		{
-			std::string biases_string = json_string.substr(pos, end_pos - pos);
-			std::vector<std::string> biases_strings = split(biases_string, ';');
-			for (const std::string &bias_string : biases_strings)
-			{
-				std::vector<double> bias;
-				std::vector<std::string> bias_strings = split(bias_string, ',');
-				for (const std::string &bias_value_string : bias_strings)
-				{
-					bias.push_back(std::stod(bias_value_string));
-				}
-				biases.push_back(bias);
-			}
-		}
+		num_weights += network.getLayer(l).getWeights().size();
+		num_biases += network.getLayer(l).getBiases().size();
 	}
+	std::vector<double> values(num_weights + num_biases);
 
-	// Extract weights
-	pos = json_string.find("\"weights\": [");
-	if (pos != std::string::npos)
+	std::vector<std::span<double>> weights;
+	std::vector<std::span<double>> biases;
+	double *weight_cursor = values.data();
+	double *bias_cursor = values.data() + num_weights;
+	for (unsigned int l = 0; l < network.size(); l++)
 	{
-		pos += 12;
-		size_t end_pos = json_string.find("]", pos);
-		if (end_pos != std::string::npos)
-		{
-			std::string weights_string = json_string.substr(pos, end_pos - pos);
-			std::vector<std::string> weights_strings = split(weights_string, ';');
-			for (const std::string &layer_weights_string : weights_strings)
-			{
-				std::vector<std::vector<double>> layer_weights;
-				std::vector<std::string> neuron_weights_strings = split(layer_weights_string, '|');
-				for (const std::string &neuron_weights_string : neuron_weights_strings)
-				{
-					std::vector<double> neuron_weights;
-					std::vector<std::string> weight_strings = split(neuron_weights_string, ',');
-					for (const std::string &weight_string : weight_strings)
-					{
-						neuron_weights.push_back(std::stod(weight_string));
-					}
-					layer_weights.push_back(neuron_weights);
-				}
-				weights.push_back(layer_weights);
-			}
-		}
+		const Layer &layer = network.getLayer(l);
+		weights.emplace_back(weight_cursor, layer.getWeights().size());
+		biases.emplace_back(bias_cursor, layer.getBiases().size());
+		weight_cursor += layer.getWeights().size();
+		bias_cursor += layer.getBiases().size();
 	}
 
-	network.importWeightsBiases(biases, weights);
-}
\ No newline at end of file
+	// Skip the keys themselves, both sections must hold exactly the network's values
+	parse_section(json + weights_pos + 9, weights_end, weights);
+	parse_section(json + biases_pos + 8, biases_end, biases);
+
+	// Install the values and drop pruning masks, which belonged to the old weights
+	for (unsigned int l = 0; l < network.size(); l++)
+	{
+		Layer &layer = network.getLayer(l);
+		std::copy(weights[l].begin(), weights[l].end(), layer.getWeights().begin());
+		std::copy(biases[l].begin(), biases[l].end(), layer.getBiases().begin());
+		layer.clearMask();
+	}
+}
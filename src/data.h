@@ -2,6 +2,7 @@
 #define DATA_H
 
 #include "network.h"
+#include "dataset.h"
 
 #include <string>
 #include <stdint.h> // For uint8_t
@@ -12,13 +13,18 @@ uint8_t **read_mnist_images(std::string full_path, int number_of_images, int ima
 // Function to read MNIST image labels.
 uint8_t *read_mnist_labels(std::string full_path, int number_of_labels);
 
+// Load MNIST images and labels as a dataset with normalized inputs and one-hot targets.
+Dataset load_mnist(std::string images_path, std::string labels_path, int number_of_images);
+
 // Print image to console.
 void print_image(std::vector<double> image, int width, int height);
 
-// Function to export a network to a json file.
-void export_network(Network network, std::string filename);
+// Function to export a network to a json file, streaming the weights and biases from the layers.
+// Returns false if the file could not be opened or written.
+bool export_network(const Network &network, const std::string &filename);
 
-// Function to import a network from a json file.
-void import_network(Network &network, std::string filename);
+// Function to import a network from a json file written by export_network. The layers' shape must
+// match the file. Values are checked before any layer is changed, and pruning masks are cleared.
+void import_network(Network &network, const std::string &filename);
 
 #endif // DATA_H
\ No newline at end of file
@@ -0,0 +1,20 @@
+#ifndef DATASET_H
+#define DATASET_H
+
+#include <vector>
+#include <cstddef> // For size_t
+
+// A set of input samples with their target outputs.
+struct Dataset
+{
+	std::vector<std::vector<double>> inputs;  // Input vector for each sample.
+	std::vector<std::vector<double>> targets; // Target vector for each sample.
+
+	// Get the number of samples in the dataset.
+	size_t size() const
+	{
+		return inputs.size();
+	}
+};
+
+#endif // DATASET_H
@@ -0,0 +1,110 @@
+#include "dense.h"
+
+#include <algorithm> // For min
+#include <stdexcept> // For runtime_error
+
+// Largest batch run through the kernels at once
+#define DENSE_MAX_BATCH 64
+
+DenseNetwork::DenseNetwork(const Network &network, Autotuner &autotuner) : input_size(network.inputSize()), autotuner(autotuner)
+{
+	this->layers.reserve(network.size());
+	for (unsigned int l = 0; l < network.size(); l++)
+	{
+		const Layer &layer = network.getLayer(l);
+		if (layer.getType() != LayerType::Dense)
+		{
+			throw std::runtime_error("Dense networks only support fully connected layers.");
+		}
+		std::span<const double> weights = layer.getWeights();
+		std::span<const double> biases = layer.getBiases();
+
+		DenseLayer dense;
+		dense.num_neurons = layer.size();
+		dense.num_inputs = layer.inputSize();
+		dense.biases.assign(biases.begin(), biases.end());
+		dense.activation = layer.getActivation();
+		dense.weights.assign(weights.begin(), weights.end());
+
+		this->single_choices.emplace_back(autotuner.select(dense.num_neurons, dense.num_inputs, 1));
+		this->layers.emplace_back(std::move(dense));
+	}
+}
+
+void DenseNetwork::activate(const DenseLayer &layer, double *values, unsigned int batch)
+{
+	for (unsigned int b = 0; b < batch; b++)
+	{
+		double *sample = values + (size_t)b * layer.num_neurons;
+		for (unsigned int i = 0; i < layer.num_neurons; i++)
+		{
+			sample[i] = layer.activation.function(sample[i]);
+		}
+		if (layer.activation.normalize)
+		{
+			layer.activation.normalize(sample, layer.num_neurons);
+		}
+	}
+}
+
+void DenseNetwork::predict(const std::vector<double> &input, std::vector<double> &output) const
+{
+	if (input.size() != this->input_size)
+	{
+		throw std::runtime_error("Input size does not match network input size.");
+	}
+
+	thread_local std::vector<double> buffer;
+
+	const std::vector<double> *current_inputs = &input;
+	for (size_t l = 0; l < this->layers.size(); l++)
+	{
+		const DenseLayer &layer = this->layers[l];
+		const KernelChoice &choice = this->single_choices[l];
+		std::vector<double> &outputs = (this->layers.size() - 1 - l) % 2 == 0 ? output : buffer;
+		outputs.resize(layer.num_neurons);
+
+		run_dense_kernel(*choice.kernel, layer.weights.data(), layer.biases.data(), current_inputs->data(), outputs.data(), layer.num_neurons, layer.num_inputs, 1, choice.num_threads);
+		activate(layer, outputs.data(), 1);
+		current_inputs = &outputs;
+	}
+}
+
+void DenseNetwork::predict(const std::vector<std::vector<double>> &inputs, std::vector<std::vector<double>> &outputs) const
+{
+	outputs.resize(inputs.size());
+
+	std::vector<double> current;
+	std::vector<double> next;
+
+	for (size_t begin = 0; begin < inputs.size(); begin += DENSE_MAX_BATCH)
+	{
+		unsigned int batch = std::min<size_t>(DENSE_MAX_BATCH, inputs.size() - begin);
+
+		current.resize((size_t)batch * this->input_size);
+		for (unsigned int b = 0; b < batch; b++)
+		{
+			if (inputs[begin + b].size() != this->input_size)
+			{
+				throw std::runtime_error("Input size does not match network input size.");
+			}
+			std::copy(inputs[begin + b].begin(), inputs[begin + b].end(), current.begin() + (size_t)b * this->input_size);
+		}
+
+		for (const DenseLayer &layer : this->layers)
+		{
+			KernelChoice choice = this->autotuner.select(layer.num_neurons, layer.num_inputs, batch);
+
+			next.resize((size_t)batch * layer.num_neurons);
+			run_dense_kernel(*choice.kernel, layer.weights.data(), layer.biases.data(), current.data(), next.data(), layer.num_neurons, layer.num_inputs, batch, choice.num_threads);
+			activate(layer, next.data(), batch);
+			current.swap(next);
+		}
+
+		unsigned int output_size = this->layers.back().num_neurons;
+		for (unsigned int b = 0; b < batch; b++)
+		{
+			outputs[begin + b].assign(current.begin() + (size_t)b * output_size, current.begin() + (size_t)(b + 1) * output_size);
+		}
+	}
+}
@@ -0,0 +1,44 @@
+#ifndef DENSE_H
+#define DENSE_H
+
+#include "network.h"
+#include "activation.h"
+#include "autotuner.h"
+
+#include <vector>
+
+// Fully connected layer with contiguous row-major weights.
+struct DenseLayer
+{
+	unsigned int num_neurons;    // Number of rows.
+	unsigned int num_inputs;     // Number of columns.
+	std::vector<double> weights; // Row-major weights.
+	std::vector<double> biases;  // Bias for each neuron.
+	Activation activation;       // Activation function for the layer.
+};
+
+// Read-only inference copy of a network that runs each layer with the kernel the autotuner picked
+// for its shape and batch size.
+class DenseNetwork
+{
+public:
+	// Compile a network, tuning single-sample kernels for each layer shape.
+	DenseNetwork(const Network &network, Autotuner &autotuner);
+
+	// Make a prediction for a single input.
+	void predict(const std::vector<double> &input, std::vector<double> &output) const;
+
+	// Make predictions for a batch of inputs, tuning kernels for new batch sizes on demand.
+	void predict(const std::vector<std::vector<double>> &inputs, std::vector<std::vector<double>> &outputs) const;
+
+private:
+	unsigned int input_size;                  // Number of inputs to the network.
+	std::vector<DenseLayer> layers;           // Layers in the network.
+	std::vector<KernelChoice> single_choices; // Tuned kernel of each layer for one sample.
+	Autotuner &autotuner;                     // Source of kernel choices for batches.
+
+	// Apply the layer activation in place to each sample of a batch.
+	static void activate(const DenseLayer &layer, double *values, unsigned int batch);
+};
+
+#endif // DENSE_H
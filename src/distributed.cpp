@@ -0,0 +1,400 @@
+#include "distributed.h"
+
+#include <algorithm> // For min
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>   // For strncpy
+#include <exception> // For exception_ptr
+#include <mutex>
+#include <queue>
+#include <stdexcept> // For runtime_error
+#include <thread>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Time to keep retrying the connection to the next rank while it starts up
+#define CONNECT_RETRIES 500
+#define CONNECT_RETRY_MS 10
+
+static sockaddr_un socket_address(const std::string &path)
+{
+	sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(address.sun_path))
+	{
+		throw std::runtime_error("Socket path `" + path + "` is too long!");
+	}
+	std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+	return address;
+}
+
+UnixSocketTransport::UnixSocketTransport(const std::string &path, unsigned int rank, unsigned int size) : ring_rank(rank), ring_size(size), next_fd(-1), previous_fd(-1)
+{
+	if (rank >= size)
+	{
+		throw std::runtime_error("Rank must be smaller than the ring size.");
+	}
+
+	if (size == 1)
+	{
+		return;
+	}
+
+	// Listen before connecting, a pending connection completes without being accepted
+	this->socket_path = path + "." + std::to_string(rank);
+	sockaddr_un listen_address = socket_address(this->socket_path);
+	sockaddr_un next_address = socket_address(path + "." + std::to_string((rank + 1) % size));
+	unlink(this->socket_path.c_str());
+
+	int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listen_fd < 0 || bind(listen_fd, (sockaddr *)&listen_address, sizeof(listen_address)) != 0 || listen(listen_fd, 1) != 0)
+	{
+		if (listen_fd >= 0)
+		{
+			close(listen_fd);
+		}
+		std::string message = "Unable to listen on `" + this->socket_path + "`!";
+		this->release();
+		throw std::runtime_error(message);
+	}
+
+	for (int attempt = 0; attempt < CONNECT_RETRIES && this->next_fd < 0; attempt++)
+	{
+		int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd >= 0 && connect(fd, (sockaddr *)&next_address, sizeof(next_address)) == 0)
+		{
+			this->next_fd = fd;
+		}
+		else
+		{
+			if (fd >= 0)
+			{
+				close(fd);
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(CONNECT_RETRY_MS));
+		}
+	}
+
+	if (this->next_fd >= 0)
+	{
+		this->previous_fd = accept(listen_fd, nullptr, nullptr);
+	}
+	close(listen_fd);
+
+	if (this->next_fd < 0 || this->previous_fd < 0)
+	{
+		this->release();
+		throw std::runtime_error("Unable to connect the transport ring at `" + path + "`!");
+	}
+}
+
+UnixSocketTransport::~UnixSocketTransport()
+{
+	this->release();
+}
+
+void UnixSocketTransport::release()
+{
+	if (this->next_fd >= 0)
+	{
+		close(this->next_fd);
+		this->next_fd = -1;
+	}
+	if (this->previous_fd >= 0)
+	{
+		close(this->previous_fd);
+		this->previous_fd = -1;
+	}
+	if (!this->socket_path.empty())
+	{
+		unlink(this->socket_path.c_str());
+		this->socket_path.clear();
+	}
+}
+
+unsigned int UnixSocketTransport::rank() const
+{
+	return this->ring_rank;
+}
+
+unsigned int UnixSocketTransport::size() const
+{
+	return this->ring_size;
+}
+
+void UnixSocketTransport::exchange(const void *send_data, size_t send_bytes, void *receive_data, size_t receive_bytes)
+{
+	const char *send_pointer = (const char *)send_data;
+	char *receive_pointer = (char *)receive_data;
+
+	// Send and receive together, every rank sending first would deadlock once the socket buffers fill
+	while (send_bytes > 0 || receive_bytes > 0)
+	{
+		pollfd fds[2] = {{this->next_fd, (short)(send_bytes > 0 ? POLLOUT : 0), 0}, {this->previous_fd, (short)(receive_bytes > 0 ? POLLIN : 0), 0}};
+		if (poll(fds, 2, -1) < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			throw std::runtime_error("Transport poll failed!");
+		}
+
+		if (fds[0].revents & (POLLOUT | POLLERR | POLLHUP))
+		{
+			ssize_t sent = send(this->next_fd, send_pointer, send_bytes, MSG_DONTWAIT | MSG_NOSIGNAL);
+			if (sent < 0 && errno != EAGAIN && errno != EINTR)
+			{
+				throw std::runtime_error("Transport send failed!");
+			}
+			if (sent > 0)
+			{
+				send_pointer += sent;
+				send_bytes -= sent;
+			}
+		}
+
+		if (fds[1].revents & (POLLIN | POLLERR | POLLHUP))
+		{
+			ssize_t received = recv(this->previous_fd, receive_pointer, receive_bytes, MSG_DONTWAIT);
+			if (received == 0 || (received < 0 && errno != EAGAIN && errno != EINTR))
+			{
+				throw std::runtime_error("Transport receive failed!");
+			}
+			if (received > 0)
+			{
+				receive_pointer += received;
+				receive_bytes -= received;
+			}
+		}
+	}
+}
+
+void ring_all_reduce(Transport &transport, std::span<double> values, Reduction reduction)
+{
+	unsigned int size = transport.size();
+	unsigned int rank = transport.rank();
+	if (size == 1 || values.empty())
+	{
+		return;
+	}
+
+	// Split the values into one chunk per rank
+	auto chunk_begin = [&](unsigned int chunk)
+	{
+		return values.size() * chunk / size;
+	};
+	auto chunk_size = [&](unsigned int chunk)
+	{
+		return chunk_begin(chunk + 1) - chunk_begin(chunk);
+	};
+
+	std::vector<double> received(chunk_size(0) + 1);
+
+	// Reduce-scatter: after size - 1 steps each rank holds the full reduction of chunk (rank + 1) % size
+	for (unsigned int step = 0; step < size - 1; step++)
+	{
+		unsigned int send_chunk = (rank + size - step) % size;
+		unsigned int receive_chunk = (rank + size - step - 1) % size;
+
+		received.resize(chunk_size(receive_chunk));
+		transport.exchange(&values[chunk_begin(send_chunk)], chunk_size(send_chunk) * sizeof(double), received.data(), received.size() * sizeof(double));
+
+		double *target = &values[chunk_begin(receive_chunk)];
+		if (reduction == Reduction::Sum)
+		{
+			for (size_t i = 0; i < received.size(); i++)
+			{
+				target[i] += received[i];
+			}
+		}
+		else
+		{
+			for (size_t i = 0; i < received.size(); i++)
+			{
+				target[i] = std::min(target[i], received[i]);
+			}
+		}
+	}
+
+	// All-gather: pass the reduced chunks around the ring
+	for (unsigned int step = 0; step < size - 1; step++)
+	{
+		unsigned int send_chunk = (rank + 1 + size - step) % size;
+		unsigned int receive_chunk = (rank + size - step) % size;
+
+		transport.exchange(&values[chunk_begin(send_chunk)], chunk_size(send_chunk) * sizeof(double), &values[chunk_begin(receive_chunk)], chunk_size(receive_chunk) * sizeof(double));
+	}
+}
+
+DataParallelTrainer::DataParallelTrainer(Network &network, Transport &transport) : network(network), transport(transport)
+{
+	// Constructor, if necessary
+}
+
+void DataParallelTrainer::broadcastWeights()
+{
+	// Summing rank 0's values with zeros from every other rank is a broadcast, done in place
+	for (unsigned int l = 0; l < this->network.size(); l++)
+	{
+		Layer &layer = this->network.getLayer(l);
+		for (std::span<double> values : {layer.getBiases(), layer.getWeights()})
+		{
+			if (this->transport.rank() != 0)
+			{
+				std::fill(values.begin(), values.end(), 0.0);
+			}
+			ring_all_reduce(this->transport, values);
+		}
+	}
+}
+
+void DataParallelTrainer::train(const Dataset &shard, double learning_rate, int epochs, unsigned int batch_size)
+{
+	if (shard.inputs.size() != shard.targets.size())
+	{
+		throw std::runtime_error("Input and target data have different sizes.");
+	}
+	if (batch_size == 0)
+	{
+		throw std::runtime_error("Batch size must be positive.");
+	}
+
+	this->broadcastWeights();
+
+	// Every rank must run the same number of batches
+	std::vector<double> batches = {(double)(shard.size() / batch_size)};
+	ring_all_reduce(this->transport, batches, Reduction::Min);
+	size_t num_batches = batches[0];
+
+	if (num_batches == 0)
+	{
+		throw std::runtime_error("A shard is smaller than the batch size.");
+	}
+
+	// Gradients are summed over every rank's batch, scale them back to a mean
+	double step = learning_rate / (batch_size * this->transport.size());
+
+	// Communication thread reducing layers in the order backpropagation completes them
+	std::mutex mutex;
+	std::condition_variable ready;
+	std::condition_variable reduced;
+	std::queue<int> pending;
+	size_t outstanding = 0;
+	std::exception_ptr failure; // Transport error on the communication thread.
+
+	std::thread communication([&]()
+							  {
+		while (true)
+		{
+			int layer;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				ready.wait(lock, [&]() { return !pending.empty(); });
+				layer = pending.front();
+				pending.pop();
+			}
+
+			// A negative layer shuts the thread down
+			if (layer < 0)
+			{
+				return;
+			}
+
+			try
+			{
+				ring_all_reduce(this->transport, this->network.getGradients(layer));
+			}
+			catch (...)
+			{
+				// Hand the error to the training loop, the transport is unusable from here on
+				std::lock_guard<std::mutex> lock(mutex);
+				failure = std::current_exception();
+				reduced.notify_one();
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(mutex);
+			outstanding--;
+			reduced.notify_one();
+		} });
+
+	auto stop_communication = [&]()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			pending.push(-1);
+			ready.notify_one();
+		}
+		communication.join();
+	};
+
+	auto layer_ready = [&](unsigned int layer)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		pending.push(layer);
+		outstanding++;
+		ready.notify_one();
+	};
+
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+
+	if (this->transport.rank() == 0)
+	{
+		printf("\nTraining network on %u processes...\n\n", this->transport.size());
+	}
+
+	// The communication thread must be joined however training ends
+	try
+	{
+		for (int epoch = 0; epoch < epochs; ++epoch)
+		{
+			double epoch_loss = 0.0;
+
+			for (size_t batch = 0; batch < num_batches; batch++)
+			{
+				size_t first = batch * batch_size;
+				for (size_t i = first; i < first + batch_size; i++)
+				{
+					// Each layer's gradients are final once the batch's last sample has passed it
+					bool last = i == first + batch_size - 1;
+					epoch_loss += this->network.accumulateGradients(shard.inputs[i], shard.targets[i], last ? layer_ready : std::function<void(unsigned int)>());
+				}
+
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					reduced.wait(lock, [&]() { return outstanding == 0 || failure; });
+					if (failure)
+					{
+						std::rethrow_exception(failure);
+					}
+				}
+
+				this->network.applyGradients(step);
+			}
+
+			// Mean loss over every rank's samples
+			std::vector<double> loss = {epoch_loss / (num_batches * batch_size)};
+			ring_all_reduce(this->transport, loss);
+
+			if (this->transport.rank() == 0)
+			{
+				Network::printProgress(epoch, epochs, loss[0] / this->transport.size(), begin);
+			}
+		}
+	}
+	catch (...)
+	{
+		stop_communication();
+		throw;
+	}
+	stop_communication();
+
+	if (this->transport.rank() == 0)
+	{
+		printf("\nTraining complete for %d epochs with a learning rate of %.2f.\n\n", epochs, learning_rate);
+	}
+}
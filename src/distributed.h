@@ -0,0 +1,84 @@
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+
+#include "network.h"
+#include "dataset.h"
+
+#include <string>
+#include <vector>
+#include <span>
+
+// Point-to-point link of one process in a ring of processes.
+class Transport
+{
+public:
+	virtual ~Transport() = default;
+
+	// Get the rank of this process in the ring.
+	virtual unsigned int rank() const = 0;
+
+	// Get the number of processes in the ring.
+	virtual unsigned int size() const = 0;
+
+	// Send bytes to the next rank while receiving bytes from the previous rank.
+	virtual void exchange(const void *send_data, size_t send_bytes, void *receive_data, size_t receive_bytes) = 0;
+};
+
+// Ring transport over UNIX domain sockets for processes on the same host. Each rank listens on
+// "<path>.<rank>" and connects to the next rank's socket.
+class UnixSocketTransport : public Transport
+{
+public:
+	UnixSocketTransport(const std::string &path, unsigned int rank, unsigned int size);
+	~UnixSocketTransport() override;
+
+	UnixSocketTransport(const UnixSocketTransport &) = delete;
+	UnixSocketTransport &operator=(const UnixSocketTransport &) = delete;
+
+	unsigned int rank() const override;
+	unsigned int size() const override;
+	void exchange(const void *send_data, size_t send_bytes, void *receive_data, size_t receive_bytes) override;
+
+private:
+	unsigned int ring_rank;   // Rank of this process.
+	unsigned int ring_size;   // Number of processes.
+	std::string socket_path;  // Path this rank listens on.
+	int next_fd;              // Connection to the next rank.
+	int previous_fd;          // Connection from the previous rank.
+
+	// Close the connections and remove the socket file, also on constructor failure.
+	void release();
+};
+
+// Reduction applied by ring_all_reduce.
+enum class Reduction
+{
+	Sum,
+	Min,
+};
+
+// Ring all-reduce: every rank ends up with the element-wise reduction of all ranks' values.
+void ring_all_reduce(Transport &transport, std::span<double> values, Reduction reduction = Reduction::Sum);
+
+// Data-parallel mini-batch training across the processes of a transport ring. Each process trains
+// on its own shard and the gradients are summed with a ring all-reduce. Each layer's reduction runs
+// on a communication thread while the layers below it are still being backpropagated.
+class DataParallelTrainer
+{
+public:
+	DataParallelTrainer(Network &network, Transport &transport);
+
+	// Train the network on this process's shard. Every rank must call this with the same
+	// arguments. Rank 0's weights are broadcast first so all replicas start identical, and each
+	// epoch runs as many batches as the smallest shard has.
+	void train(const Dataset &shard, double learning_rate, int epochs, unsigned int batch_size);
+
+private:
+	Network &network;      // Local replica of the network.
+	Transport &transport;  // Ring connecting the replicas.
+
+	// Replace every rank's weights with rank 0's.
+	void broadcastWeights();
+};
+
+#endif // DISTRIBUTED_H
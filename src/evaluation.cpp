@@ -0,0 +1,210 @@
+#include "evaluation.h"
+#include "team.h"
+
+#include <cstdio>
+#include <stdexcept> // For runtime_error
+#include <algorithm> // For min
+#include <atomic>
+#include <exception> // For exception_ptr
+#include <mutex>
+#include <thread>
+
+#define EVALUATION_BATCH_SIZE 256
+
+size_t argmax(const std::vector<double> &values)
+{
+	size_t max_index = 0;
+	double max_value = values[0];
+	for (size_t i = 1; i < values.size(); i++)
+	{
+		bool greater = values[i] > max_value;
+		max_index = greater ? i : max_index;
+		max_value = greater ? values[i] : max_value;
+	}
+	return max_index;
+}
+
+bool in_top_k(const std::vector<double> &values, size_t index, unsigned int k)
+{
+	// The value is in the top k if fewer than k values are strictly larger, no sorting needed
+	double value = values[index];
+	unsigned int larger = 0;
+	for (size_t i = 0; i < values.size(); i++)
+	{
+		larger += values[i] > value;
+	}
+	return larger < k;
+}
+
+Evaluation evaluate(const Network &network, const Dataset &dataset, unsigned int top_k, unsigned int num_threads)
+{
+	if (dataset.inputs.size() != dataset.targets.size())
+	{
+		throw std::runtime_error("Input and target data have different sizes.");
+	}
+
+	if (dataset.size() == 0)
+	{
+		throw std::runtime_error("Cannot evaluate an empty dataset.");
+	}
+	if (network.size() == 0)
+	{
+		throw std::runtime_error("Cannot evaluate an empty network.");
+	}
+
+	// Check every sample here, the workers index the confusion matrix by the output size
+	size_t num_classes = network.getLayer(network.size() - 1).size();
+	for (size_t i = 0; i < dataset.size(); i++)
+	{
+		if (dataset.inputs[i].size() != network.inputSize())
+		{
+			throw std::runtime_error("Input data size does not match input layer size.");
+		}
+		if (dataset.targets[i].size() != num_classes)
+		{
+			throw std::runtime_error("Target data size does not match output layer size.");
+		}
+	}
+	size_t num_batches = (dataset.size() + EVALUATION_BATCH_SIZE - 1) / EVALUATION_BATCH_SIZE;
+
+	if (num_threads == 0)
+	{
+		num_threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	num_threads = std::min<size_t>(num_threads, num_batches);
+
+	// Per-thread tallies, merged once all batches are scored
+	std::vector<std::vector<size_t>> confusions(num_threads, std::vector<size_t>(num_classes * num_classes, 0));
+	std::vector<size_t> top_k_hits(num_threads, 0);
+
+	// Loss is accumulated per batch and summed in order so the result does not depend on scheduling
+	std::vector<double> batch_losses(num_batches, 0.0);
+
+	std::atomic<size_t> next_batch(0);
+	std::mutex failure_mutex;
+	std::exception_ptr failure; // First worker error, rethrown after the join.
+
+	auto worker = [&](unsigned int thread)
+	{
+		// Batches already use every thread, so the kernels inside predict stay serial
+		WorkerScope scope(num_threads > 1);
+		std::vector<double> output;
+		std::vector<size_t> &confusion = confusions[thread];
+		size_t hits = 0;
+
+		try
+		{
+			for (size_t batch = next_batch++; batch < num_batches; batch = next_batch++)
+			{
+				size_t begin = batch * EVALUATION_BATCH_SIZE;
+				size_t end = std::min(begin + EVALUATION_BATCH_SIZE, dataset.size());
+
+				double loss = 0.0;
+				for (size_t i = begin; i < end; i++)
+				{
+					const std::vector<double> &target = dataset.targets[i];
+
+					network.predict(dataset.inputs[i], output);
+
+					size_t actual = argmax(target);
+					size_t predicted = argmax(output);
+
+					confusion[actual * num_classes + predicted]++;
+					hits += in_top_k(output, actual, top_k);
+					loss += network.computeLoss(output, target);
+				}
+				batch_losses[batch] = loss;
+			}
+		}
+		catch (...)
+		{
+			// Keep the first error and stop the other workers at their next batch
+			std::lock_guard<std::mutex> lock(failure_mutex);
+			if (!failure)
+			{
+				failure = std::current_exception();
+			}
+			next_batch = num_batches;
+		}
+
+		top_k_hits[thread] = hits;
+	};
+
+	std::vector<std::thread> threads;
+	threads.reserve(num_threads - 1);
+	for (unsigned int t = 1; t < num_threads; t++)
+	{
+		threads.emplace_back(worker, t);
+	}
+	worker(0);
+	for (std::thread &thread : threads)
+	{
+		thread.join();
+	}
+
+	if (failure)
+	{
+		std::rethrow_exception(failure);
+	}
+
+	Evaluation evaluation;
+	evaluation.samples = dataset.size();
+	evaluation.correct = 0;
+	evaluation.top_k = top_k;
+	evaluation.confusion.assign(num_classes, std::vector<size_t>(num_classes, 0));
+
+	size_t top_k_correct = 0;
+	for (unsigned int t = 0; t < num_threads; t++)
+	{
+		for (size_t actual = 0; actual < num_classes; actual++)
+		{
+			for (size_t predicted = 0; predicted < num_classes; predicted++)
+			{
+				evaluation.confusion[actual][predicted] += confusions[t][actual * num_classes + predicted];
+			}
+		}
+		top_k_correct += top_k_hits[t];
+	}
+
+	for (size_t c = 0; c < num_classes; c++)
+	{
+		evaluation.correct += evaluation.confusion[c][c];
+	}
+
+	double loss = 0.0;
+	for (double batch_loss : batch_losses)
+	{
+		loss += batch_loss;
+	}
+
+	evaluation.accuracy = (double)evaluation.correct / evaluation.samples;
+	evaluation.top_k_accuracy = (double)top_k_correct / evaluation.samples;
+	evaluation.mean_loss = loss / evaluation.samples;
+
+	return evaluation;
+}
+
+void print_evaluation(const Evaluation &evaluation)
+{
+	printf("Accuracy: %.2f%% (%zu/%zu) - Top-%u: %.2f%% - Loss: %.4e\n\n", evaluation.accuracy * 100, evaluation.correct, evaluation.samples, evaluation.top_k, evaluation.top_k_accuracy * 100, evaluation.mean_loss);
+
+	// Header row of predicted classes
+	printf("      ");
+	for (size_t predicted = 0; predicted < evaluation.confusion.size(); predicted++)
+	{
+		printf("%6zu", predicted);
+	}
+	printf("\n");
+
+	// One row per actual class
+	for (size_t actual = 0; actual < evaluation.confusion.size(); actual++)
+	{
+		printf("%6zu", actual);
+		for (size_t predicted = 0; predicted < evaluation.confusion[actual].size(); predicted++)
+		{
+			printf("%6zu", evaluation.confusion[actual][predicted]);
+		}
+		printf("\n");
+	}
+	printf("\n");
+}
@@ -0,0 +1,35 @@
+#ifndef EVALUATION_H
+#define EVALUATION_H
+
+#include "network.h"
+#include "dataset.h"
+
+#include <vector>
+
+// Results of scoring a network against a labeled dataset.
+struct Evaluation
+{
+	size_t samples;                                   // Number of samples scored.
+	size_t correct;                                   // Number of samples whose top prediction matches the label.
+	double accuracy;                                  // Fraction of samples predicted correctly.
+	unsigned int top_k;                               // K used for the top-k accuracy.
+	double top_k_accuracy;                            // Fraction of samples whose label is among the k highest outputs.
+	double mean_loss;                                 // Mean loss of the output layer over the dataset.
+	std::vector<std::vector<size_t>> confusion;       // Confusion matrix indexed by [actual][predicted].
+};
+
+// Score the network on a dataset in parallel batches. Labels are the argmax of each target vector.
+// Uses all hardware threads when num_threads is 0. Every input and target size is checked against
+// the network before scoring starts.
+Evaluation evaluate(const Network &network, const Dataset &dataset, unsigned int top_k = 5, unsigned int num_threads = 0);
+
+// Get the index of the largest value.
+size_t argmax(const std::vector<double> &values);
+
+// Check whether the value at index is among the k largest values.
+bool in_top_k(const std::vector<double> &values, size_t index, unsigned int k);
+
+// Print an evaluation summary and confusion matrix to the console.
+void print_evaluation(const Evaluation &evaluation);
+
+#endif // EVALUATION_H
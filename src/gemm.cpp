@@ -0,0 +1,335 @@
+#include "gemm.h"
+#include "kernels.h"
+#include "team.h"
+
+#include <algorithm> // For min, max
+#include <thread>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define GEMM_X86
+#endif
+
+// Columns per cache block, keeping a panel slice (16 x 128 doubles) in L1
+#define GEMM_BLOCK_DEPTH 128
+
+// Largest number of samples computed together by a micro-kernel
+#define GEMM_MAX_SAMPLES 8
+
+// Minimum number of weights per thread before the work is split
+#define GEMM_WEIGHTS_PER_THREAD (1 << 17)
+
+// Columns per cache line, column ranges split across threads are a multiple of it
+#define GEMM_LINE_DOUBLES 8
+
+// Micro-kernel loops over samples and vectors are fully unrolled so the accumulators stay in registers.
+
+// Computes a GEMM_PANEL_ROWS x samples tile over depth columns of a panel, overwriting tile with
+// tile[s * GEMM_PANEL_ROWS + r]. Sample s reads inputs[s * cols + k].
+typedef void (*MicroKernel)(const double *panel, const double *inputs, unsigned int cols, unsigned int depth, double *tile);
+
+// A micro-kernel for full sample tiles and one for single leftover samples.
+struct GemmKernel
+{
+	unsigned int samples; // Samples computed by the full kernel.
+	MicroKernel full;     // Kernel for tiles of samples samples.
+	MicroKernel single;   // Kernel for one sample.
+};
+
+template <unsigned int NR>
+static void micro_scalar(const double *panel, const double *inputs, unsigned int cols, unsigned int depth, double *tile)
+{
+	double sums[NR][GEMM_PANEL_ROWS] = {};
+	for (unsigned int k = 0; k < depth; k++)
+	{
+		const double *column = panel + (size_t)k * GEMM_PANEL_ROWS;
+		for (unsigned int s = 0; s < NR; s++)
+		{
+			double x = inputs[(size_t)s * cols + k];
+			for (unsigned int r = 0; r < GEMM_PANEL_ROWS; r++)
+			{
+				sums[s][r] += column[r] * x;
+			}
+		}
+	}
+	for (unsigned int s = 0; s < NR; s++)
+	{
+		for (unsigned int r = 0; r < GEMM_PANEL_ROWS; r++)
+		{
+			tile[s * GEMM_PANEL_ROWS + r] = sums[s][r];
+		}
+	}
+}
+
+#ifdef GEMM_X86
+template <unsigned int NR>
+__attribute__((target("avx2,fma"))) static void micro_avx2(const double *panel, const double *inputs, unsigned int cols, unsigned int depth, double *tile)
+{
+	__m256d sums[NR][4];
+	#pragma GCC unroll 16
+	for (unsigned int s = 0; s < NR; s++)
+	{
+		#pragma GCC unroll 16
+		for (unsigned int v = 0; v < 4; v++)
+		{
+			sums[s][v] = _mm256_setzero_pd();
+		}
+	}
+
+	for (unsigned int k = 0; k < depth; k++)
+	{
+		const double *column = panel + (size_t)k * GEMM_PANEL_ROWS;
+		__m256d a0 = _mm256_loadu_pd(column);
+		__m256d a1 = _mm256_loadu_pd(column + 4);
+		__m256d a2 = _mm256_loadu_pd(column + 8);
+		__m256d a3 = _mm256_loadu_pd(column + 12);
+		#pragma GCC unroll 16
+		for (unsigned int s = 0; s < NR; s++)
+		{
+			__m256d x = _mm256_broadcast_sd(inputs + (size_t)s * cols + k);
+			sums[s][0] = _mm256_fmadd_pd(a0, x, sums[s][0]);
+			sums[s][1] = _mm256_fmadd_pd(a1, x, sums[s][1]);
+			sums[s][2] = _mm256_fmadd_pd(a2, x, sums[s][2]);
+			sums[s][3] = _mm256_fmadd_pd(a3, x, sums[s][3]);
+		}
+	}
+
+	#pragma GCC unroll 16
+	for (unsigned int s = 0; s < NR; s++)
+	{
+		#pragma GCC unroll 16
+		for (unsigned int v = 0; v < 4; v++)
+		{
+			_mm256_storeu_pd(tile + s * GEMM_PANEL_ROWS + v * 4, sums[s][v]);
+		}
+	}
+}
+
+template <unsigned int NR>
+__attribute__((target("avx512f"))) static void micro_avx512(const double *panel, const double *inputs, unsigned int cols, unsigned int depth, double *tile)
+{
+	__m512d sums[NR][2];
+	#pragma GCC unroll 16
+	for (unsigned int s = 0; s < NR; s++)
+	{
+		sums[s][0] = _mm512_setzero_pd();
+		sums[s][1] = _mm512_setzero_pd();
+	}
+
+	for (unsigned int k = 0; k < depth; k++)
+	{
+		const double *column = panel + (size_t)k * GEMM_PANEL_ROWS;
+		__m512d a0 = _mm512_loadu_pd(column);
+		__m512d a1 = _mm512_loadu_pd(column + 8);
+		#pragma GCC unroll 16
+		for (unsigned int s = 0; s < NR; s++)
+		{
+			__m512d x = _mm512_set1_pd(inputs[(size_t)s * cols + k]);
+			sums[s][0] = _mm512_fmadd_pd(a0, x, sums[s][0]);
+			sums[s][1] = _mm512_fmadd_pd(a1, x, sums[s][1]);
+		}
+	}
+
+	#pragma GCC unroll 16
+	for (unsigned int s = 0; s < NR; s++)
+	{
+		_mm512_storeu_pd(tile + s * GEMM_PANEL_ROWS, sums[s][0]);
+		_mm512_storeu_pd(tile + s * GEMM_PANEL_ROWS + 8, sums[s][1]);
+	}
+}
+#endif
+
+// Get the widest micro-kernel supported by this CPU, sized to keep its accumulators in registers
+static const GemmKernel &gemm_kernel()
+{
+	static const GemmKernel kernel = []() -> GemmKernel
+	{
+#ifdef GEMM_X86
+		if (__builtin_cpu_supports("avx512f"))
+		{
+			return {8, micro_avx512<8>, micro_avx512<1>};
+		}
+		if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		{
+			return {2, micro_avx2<2>, micro_avx2<1>};
+		}
+#endif
+		return {4, micro_scalar<4>, micro_scalar<1>};
+	}();
+	return kernel;
+}
+
+// Get the row-tiled dense kernel with the widest vectors
+static const DenseKernel &gemv_kernel()
+{
+	static const DenseKernel *kernel = []()
+	{
+		const DenseKernel *best = &dense_kernels().front();
+		for (const DenseKernel &candidate : dense_kernels())
+		{
+			if (candidate.vector_width >= best->vector_width && candidate.row_tile >= best->row_tile)
+			{
+				best = &candidate;
+			}
+		}
+		return best;
+	}();
+	return *kernel;
+}
+
+unsigned int gemm_threads(size_t weights)
+{
+	size_t useful = std::max<size_t>(1, weights / GEMM_WEIGHTS_PER_THREAD);
+	return (unsigned int)std::min<size_t>(useful, std::max(1u, std::thread::hardware_concurrency()));
+}
+
+void pack_weights(const double *weights, unsigned int rows, unsigned int cols, PackedWeights &packed)
+{
+	unsigned int num_panels = (rows + GEMM_PANEL_ROWS - 1) / GEMM_PANEL_ROWS;
+
+	packed.rows = rows;
+	packed.cols = cols;
+	packed.panels.resize((size_t)num_panels * cols * GEMM_PANEL_ROWS);
+
+	for (unsigned int p = 0; p < num_panels; p++)
+	{
+		double *panel = &packed.panels[(size_t)p * cols * GEMM_PANEL_ROWS];
+		for (unsigned int r = 0; r < GEMM_PANEL_ROWS; r++)
+		{
+			unsigned int row = p * GEMM_PANEL_ROWS + r;
+			const double *source = weights + (size_t)row * cols;
+			for (unsigned int k = 0; k < cols; k++)
+			{
+				panel[(size_t)k * GEMM_PANEL_ROWS + r] = row < rows ? source[k] : 0.0;
+			}
+		}
+	}
+}
+
+void gemv(const double *weights, const double *biases, const double *input, double *output, unsigned int rows, unsigned int cols, unsigned int num_threads)
+{
+	run_dense_kernel(gemv_kernel(), weights, biases, input, output, rows, cols, 1, num_threads);
+}
+
+void gemv_rows(const double *weights, const double *biases, const double *input, double *output, unsigned int cols, unsigned int row_begin, unsigned int row_end)
+{
+	gemv_kernel().function(weights, biases, input, output, cols, row_begin, row_end);
+}
+
+void gemm(const PackedWeights &packed, const double *biases, const double *inputs, double *outputs, unsigned int batch, unsigned int num_threads)
+{
+	const GemmKernel &kernel = gemm_kernel();
+	unsigned int rows = packed.rows;
+	unsigned int cols = packed.cols;
+	unsigned int num_panels = (rows + GEMM_PANEL_ROWS - 1) / GEMM_PANEL_ROWS;
+
+	auto run_panels = [&](unsigned int panel_begin, unsigned int panel_end)
+	{
+		alignas(64) double tile[GEMM_MAX_SAMPLES * GEMM_PANEL_ROWS];
+
+		for (unsigned int p = panel_begin; p < panel_end; p++)
+		{
+			unsigned int row = p * GEMM_PANEL_ROWS;
+			unsigned int valid = std::min<unsigned int>(GEMM_PANEL_ROWS, rows - row);
+			for (unsigned int b = 0; b < batch; b++)
+			{
+				std::copy(biases + row, biases + row + valid, outputs + (size_t)b * rows + row);
+			}
+		}
+
+		// Each panel slice is reused across the whole batch while it is in cache
+		for (unsigned int k = 0; k < cols; k += GEMM_BLOCK_DEPTH)
+		{
+			unsigned int depth = std::min<unsigned int>(GEMM_BLOCK_DEPTH, cols - k);
+			for (unsigned int p = panel_begin; p < panel_end; p++)
+			{
+				const double *panel = &packed.panels[((size_t)p * cols + k) * GEMM_PANEL_ROWS];
+				unsigned int row = p * GEMM_PANEL_ROWS;
+				unsigned int valid = std::min<unsigned int>(GEMM_PANEL_ROWS, rows - row);
+
+				unsigned int samples;
+				for (unsigned int b = 0; b < batch; b += samples)
+				{
+					samples = batch - b >= kernel.samples ? kernel.samples : 1;
+					MicroKernel micro = samples == kernel.samples ? kernel.full : kernel.single;
+					micro(panel, inputs + (size_t)b * cols + k, cols, depth, tile);
+
+					for (unsigned int s = 0; s < samples; s++)
+					{
+						double *output = outputs + (size_t)(b + s) * rows + row;
+						for (unsigned int r = 0; r < valid; r++)
+						{
+							output[r] += tile[s * GEMM_PANEL_ROWS + r];
+						}
+					}
+				}
+			}
+		}
+	};
+
+	parallel_ranges(num_panels, num_threads, run_panels);
+}
+
+void rank_one_update(double *weights, const double *mask, const double *scales, const double *input, unsigned int rows, unsigned int cols, unsigned int num_threads)
+{
+	auto update_rows = [&](unsigned int row_begin, unsigned int row_end)
+	{
+		for (unsigned int i = row_begin; i < row_end; i++)
+		{
+			double *row = weights + (size_t)i * cols;
+			double scale = scales[i];
+			if (mask == nullptr)
+			{
+				for (unsigned int j = 0; j < cols; j++)
+				{
+					row[j] -= scale * input[j];
+				}
+			}
+			else
+			{
+				const double *row_mask = mask + (size_t)i * cols;
+				for (unsigned int j = 0; j < cols; j++)
+				{
+					row[j] -= scale * input[j] * row_mask[j];
+				}
+			}
+		}
+	};
+
+	parallel_ranges(rows, num_threads, update_rows);
+}
+
+void backward_update(double *weights, const double *mask, const double *deltas, double learning_rate, const double *input, double *sums, unsigned int rows, unsigned int cols, unsigned int num_threads)
+{
+	auto update_columns = [&](unsigned int column_begin, unsigned int column_end)
+	{
+		for (unsigned int i = 0; i < rows; i++)
+		{
+			double *row = weights + (size_t)i * cols;
+			double delta = deltas[i];
+			double step = learning_rate * delta;
+			if (mask == nullptr)
+			{
+				for (unsigned int j = column_begin; j < column_end; j++)
+				{
+					sums[j] += delta * row[j];
+					row[j] -= step * input[j];
+				}
+			}
+			else
+			{
+				const double *row_mask = mask + (size_t)i * cols;
+				for (unsigned int j = column_begin; j < column_end; j++)
+				{
+					sums[j] += delta * row[j];
+					row[j] -= step * input[j] * row_mask[j];
+				}
+			}
+		}
+	};
+
+	// Every sum has one writer. Splits fall on multiples of a cache line of columns, so workers
+	// share at most the weight lines straddling a split, and none when cols is a multiple of
+	// GEMM_LINE_DOUBLES and rows start on line boundaries
+	parallel_ranges(cols, num_threads, update_columns, GEMM_LINE_DOUBLES);
+}
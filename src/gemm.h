@@ -0,0 +1,48 @@
+#ifndef GEMM_H
+#define GEMM_H
+
+#include <vector>
+#include <cstddef> // For size_t
+
+// Rows per packed weight panel, a multiple of every SIMD width.
+#define GEMM_PANEL_ROWS 16
+
+// Weights repacked into panels of GEMM_PANEL_ROWS rows stored column by column, so the micro-kernel
+// loads one panel column with contiguous vector loads. The last panel is zero padded.
+struct PackedWeights
+{
+	unsigned int rows;          // Rows of the original matrix.
+	unsigned int cols;          // Columns of the original matrix.
+	std::vector<double> panels; // ceil(rows / GEMM_PANEL_ROWS) panels of cols x GEMM_PANEL_ROWS values.
+};
+
+// Get the number of threads worth using for a matrix with the given number of weights. The kernels below
+// split their work on the shared team of parallel_ranges(), so calls from worker threads run serially.
+unsigned int gemm_threads(size_t weights);
+
+// Pack row-major rows x cols weights into panels, reusing the packed buffer.
+void pack_weights(const double *weights, unsigned int rows, unsigned int cols, PackedWeights &packed);
+
+// Matrix-vector product with row-major weights: output[i] = biases[i] + sum_j weights[i * cols + j] * input[j].
+// Rows are split across num_threads threads in register tiles sharing each input load.
+void gemv(const double *weights, const double *biases, const double *input, double *output, unsigned int rows, unsigned int cols, unsigned int num_threads);
+
+// Matrix-vector product for rows [row_begin, row_end) only, computed on the calling thread.
+void gemv_rows(const double *weights, const double *biases, const double *input, double *output, unsigned int cols, unsigned int row_begin, unsigned int row_end);
+
+// Matrix product with packed weights for a batch of row-major samples: outputs holds batch x rows
+// values and inputs batch x cols values. Columns are blocked to keep each panel slice in cache and
+// threads take whole panels, so every output tile is written by one thread.
+void gemm(const PackedWeights &packed, const double *biases, const double *inputs, double *outputs, unsigned int batch, unsigned int num_threads);
+
+// Rank-one update of row-major weights: weights[i * cols + j] -= scales[i] * input[j] * mask[i * cols + j].
+// The mask may be nullptr. Rows are split across num_threads threads.
+void rank_one_update(double *weights, const double *mask, const double *scales, const double *input, unsigned int rows, unsigned int cols, unsigned int num_threads);
+
+// Fused backward sweep over row-major weights: sums[j] += deltas[i] * weights[i * cols + j] using the
+// weights before the update, then weights[i * cols + j] -= learning_rate * deltas[i] * input[j] * mask[i * cols + j],
+// so each weight is read and written once. The mask may be nullptr. Columns are split at multiples of a
+// cache line across num_threads workers of the shared team, keeping every sum on one thread.
+void backward_update(double *weights, const double *mask, const double *deltas, double learning_rate, const double *input, double *sums, unsigned int rows, unsigned int cols, unsigned int num_threads);
+
+#endif // GEMM_H
@@ -0,0 +1,270 @@
+#include "half.h"
+
+#include <stdexcept> // For runtime_error
+#include <cstring>   // For memcpy
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HALF_X86
+#endif
+
+uint16_t float_to_half(float value)
+{
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+
+	uint16_t sign = (bits >> 16) & 0x8000;
+	int32_t exponent = ((bits >> 23) & 0xff) - 127 + 15;
+	uint32_t mantissa = bits & 0x7fffff;
+
+	// NaN and infinity
+	if (((bits >> 23) & 0xff) == 0xff)
+	{
+		return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+	}
+
+	// Overflow to infinity
+	if (exponent >= 31)
+	{
+		return sign | 0x7c00;
+	}
+
+	// Subnormal or zero
+	if (exponent <= 0)
+	{
+		if (exponent < -10)
+		{
+			return sign;
+		}
+		mantissa |= 0x800000;
+		uint32_t shift = 14 - exponent;
+		uint32_t half_mantissa = mantissa >> shift;
+		uint32_t remainder = mantissa & ((1u << shift) - 1);
+		uint32_t halfway = 1u << (shift - 1);
+		if (remainder > halfway || (remainder == halfway && (half_mantissa & 1)))
+		{
+			half_mantissa++;
+		}
+		return sign | half_mantissa;
+	}
+
+	// Normal, round to nearest even (a carry into the exponent is still correct)
+	uint16_t half = sign | (exponent << 10) | (mantissa >> 13);
+	uint32_t remainder = mantissa & 0x1fff;
+	if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+	{
+		half++;
+	}
+	return half;
+}
+
+float half_to_float(uint16_t value)
+{
+	uint32_t sign = (uint32_t)(value & 0x8000) << 16;
+	uint32_t exponent = (value >> 10) & 0x1f;
+	uint32_t mantissa = value & 0x3ff;
+	uint32_t bits;
+
+	if (exponent == 0x1f)
+	{
+		bits = sign | 0x7f800000 | (mantissa << 13);
+	}
+	else if (exponent != 0)
+	{
+		bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+	}
+	else if (mantissa == 0)
+	{
+		bits = sign;
+	}
+	else
+	{
+		// Normalize the subnormal
+		exponent = 127 - 15 + 1;
+		while ((mantissa & 0x400) == 0)
+		{
+			mantissa <<= 1;
+			exponent--;
+		}
+		bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+	}
+
+	float result;
+	std::memcpy(&result, &bits, sizeof(result));
+	return result;
+}
+
+uint16_t float_to_bfloat16(float value)
+{
+	uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+
+	// Keep NaN quiet instead of letting rounding turn it into infinity
+	if ((bits & 0x7fffffff) > 0x7f800000)
+	{
+		return (bits >> 16) | 0x40;
+	}
+
+	bits += 0x7fff + ((bits >> 16) & 1);
+	return bits >> 16;
+}
+
+float bfloat16_to_float(uint16_t value)
+{
+	uint32_t bits = (uint32_t)value << 16;
+	float result;
+	std::memcpy(&result, &bits, sizeof(result));
+	return result;
+}
+
+// Scalar dot product of 16-bit weights with float inputs, accumulated in float32.
+static float dot_scalar(const uint16_t *weights, const float *inputs, unsigned int size, HalfFormat format)
+{
+	float sum = 0.0f;
+	if (format == HalfFormat::Float16)
+	{
+		for (unsigned int i = 0; i < size; i++)
+		{
+			sum += half_to_float(weights[i]) * inputs[i];
+		}
+	}
+	else
+	{
+		for (unsigned int i = 0; i < size; i++)
+		{
+			sum += bfloat16_to_float(weights[i]) * inputs[i];
+		}
+	}
+	return sum;
+}
+
+#ifdef HALF_X86
+// AVX2 dot product, widening 8 weights at a time in registers with F16C or a 16-bit shift for bfloat16.
+__attribute__((target("avx2,fma,f16c"))) static float dot_avx2(const uint16_t *weights, const float *inputs, unsigned int size, HalfFormat format)
+{
+	__m256 sum0 = _mm256_setzero_ps();
+	__m256 sum1 = _mm256_setzero_ps();
+
+	unsigned int i = 0;
+	for (; i + 16 <= size; i += 16)
+	{
+		__m128i w0 = _mm_loadu_si128((const __m128i *)(weights + i));
+		__m128i w1 = _mm_loadu_si128((const __m128i *)(weights + i + 8));
+		__m256 f0, f1;
+		if (format == HalfFormat::Float16)
+		{
+			f0 = _mm256_cvtph_ps(w0);
+			f1 = _mm256_cvtph_ps(w1);
+		}
+		else
+		{
+			f0 = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(w0), 16));
+			f1 = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(w1), 16));
+		}
+		sum0 = _mm256_fmadd_ps(f0, _mm256_loadu_ps(inputs + i), sum0);
+		sum1 = _mm256_fmadd_ps(f1, _mm256_loadu_ps(inputs + i + 8), sum1);
+	}
+
+	// Horizontal sum of the two accumulators
+	__m256 sum = _mm256_add_ps(sum0, sum1);
+	__m128 low = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+	low = _mm_add_ps(low, _mm_movehl_ps(low, low));
+	low = _mm_add_ss(low, _mm_movehdup_ps(low));
+
+	return _mm_cvtss_f32(low) + dot_scalar(weights + i, inputs + i, size - i, format);
+}
+#endif
+
+// Pick the widest dot product kernel the CPU supports.
+static float dot(const uint16_t *weights, const float *inputs, unsigned int size, HalfFormat format)
+{
+#ifdef HALF_X86
+	static const bool has_avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("f16c");
+	if (has_avx2)
+	{
+		return dot_avx2(weights, inputs, size, format);
+	}
+#endif
+	return dot_scalar(weights, inputs, size, format);
+}
+
+HalfNetwork::HalfNetwork(const Network &network, HalfFormat format) : input_size(network.inputSize()), format(format)
+{
+	this->layers.reserve(network.size());
+	for (unsigned int l = 0; l < network.size(); l++)
+	{
+		const Layer &layer = network.getLayer(l);
+		if (layer.getType() != LayerType::Dense)
+		{
+			throw std::runtime_error("Half precision networks only support fully connected layers.");
+		}
+		HalfLayer half;
+		half.num_neurons = layer.size();
+		half.num_inputs = layer.inputSize();
+		half.activation = layer.getActivation();
+
+		half.biases.reserve(half.num_neurons);
+		for (double bias : layer.getBiases())
+		{
+			half.biases.emplace_back((float)bias);
+		}
+
+		half.weights.reserve((size_t)half.num_neurons * half.num_inputs);
+		for (double weight : layer.getWeights())
+		{
+			half.weights.emplace_back(format == HalfFormat::Float16 ? float_to_half((float)weight) : float_to_bfloat16((float)weight));
+		}
+
+		this->layers.emplace_back(std::move(half));
+	}
+}
+
+void HalfNetwork::predict(const std::vector<double> &input, std::vector<double> &output) const
+{
+	if (input.size() != this->input_size)
+	{
+		throw std::runtime_error("Input size does not match network input size.");
+	}
+
+	// Activations stay in float32 between layers
+	thread_local std::vector<float> current;
+	thread_local std::vector<float> next;
+	thread_local std::vector<double> values;
+
+	current.assign(input.begin(), input.end());
+
+	for (const HalfLayer &layer : this->layers)
+	{
+		values.resize(layer.num_neurons);
+		for (unsigned int i = 0; i < layer.num_neurons; i++)
+		{
+			const uint16_t *row = &layer.weights[(size_t)i * layer.num_inputs];
+			values[i] = layer.activation.function(layer.biases[i] + dot(row, current.data(), layer.num_inputs, this->format));
+		}
+		if (layer.activation.normalize)
+		{
+			layer.activation.normalize(values.data(), values.size());
+		}
+
+		next.assign(values.begin(), values.end());
+		current.swap(next);
+	}
+
+	output.assign(values.begin(), values.end());
+}
+
+HalfFormat HalfNetwork::getFormat() const
+{
+	return this->format;
+}
+
+size_t HalfNetwork::bytes() const
+{
+	size_t bytes = 0;
+	for (const HalfLayer &layer : this->layers)
+	{
+		bytes += layer.weights.size() * sizeof(uint16_t);
+		bytes += layer.biases.size() * sizeof(float);
+	}
+	return bytes;
+}
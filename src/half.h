@@ -0,0 +1,62 @@
+#ifndef HALF_H
+#define HALF_H
+
+#include "network.h"
+#include "activation.h"
+
+#include <vector>
+#include <stdint.h> // For uint16_t
+
+// 16-bit floating point formats for weight storage.
+enum class HalfFormat
+{
+	Float16,  // IEEE 754 half precision, 10 bit mantissa.
+	BFloat16, // Brain float, float32 exponent range with a 7 bit mantissa.
+};
+
+// Convert a float to IEEE half precision, rounding to nearest even.
+uint16_t float_to_half(float value);
+
+// Convert an IEEE half precision value to float.
+float half_to_float(uint16_t value);
+
+// Convert a float to bfloat16, rounding to nearest even.
+uint16_t float_to_bfloat16(float value);
+
+// Convert a bfloat16 value to float.
+float bfloat16_to_float(uint16_t value);
+
+// Fully connected layer with 16-bit weights and float32 biases.
+struct HalfLayer
+{
+	unsigned int num_neurons;     // Number of rows.
+	unsigned int num_inputs;      // Number of columns.
+	std::vector<uint16_t> weights; // Row-major 16-bit weights.
+	std::vector<float> biases;    // Bias for each neuron.
+	Activation activation;        // Activation function for the layer.
+};
+
+// Read-only inference copy of a network with 16-bit weight storage. Weights are widened to
+// float32 in registers and accumulated in float32, using F16C/AVX2 when the CPU supports it.
+class HalfNetwork
+{
+public:
+	// Compile a network, converting its weights to the given format.
+	HalfNetwork(const Network &network, HalfFormat format = HalfFormat::Float16);
+
+	// Make a prediction for a single input.
+	void predict(const std::vector<double> &input, std::vector<double> &output) const;
+
+	// Get the storage format of the weights.
+	HalfFormat getFormat() const;
+
+	// Get the number of bytes used by the weights and biases.
+	size_t bytes() const;
+
+private:
+	unsigned int input_size;        // Number of inputs to the network.
+	HalfFormat format;              // Storage format of the weights.
+	std::vector<HalfLayer> layers;  // Layers with 16-bit weights.
+};
+
+#endif // HALF_H
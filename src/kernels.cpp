@@ -0,0 +1,208 @@
+#include "kernels.h"
+#include "team.h"
+
+#include <algorithm> // For min, max
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define KERNELS_X86
+#endif
+
+// Bytes of weights per row block of a batch, half of a typical L2 cache
+#define DENSE_BLOCK_BYTES (128 << 10)
+
+template <unsigned int R>
+static void dense_scalar(const double *weights, const double *biases, const double *input, double *output, unsigned int cols, unsigned int row_begin, unsigned int row_end)
+{
+	unsigned int i = row_begin;
+	for (; i + R <= row_end; i += R)
+	{
+		double sums[R];
+		for (unsigned int r = 0; r < R; r++)
+		{
+			sums[r] = biases[i + r];
+		}
+		for (unsigned int j = 0; j < cols; j++)
+		{
+			double x = input[j];
+			for (unsigned int r = 0; r < R; r++)
+			{
+				sums[r] += weights[(size_t)(i + r) * cols + j] * x;
+			}
+		}
+		for (unsigned int r = 0; r < R; r++)
+		{
+			output[i + r] = sums[r];
+		}
+	}
+
+	// Remaining rows one at a time
+	for (; i < row_end; i++)
+	{
+		double sum = biases[i];
+		for (unsigned int j = 0; j < cols; j++)
+		{
+			sum += weights[(size_t)i * cols + j] * input[j];
+		}
+		output[i] = sum;
+	}
+}
+
+#ifdef KERNELS_X86
+__attribute__((target("avx2,fma"))) static inline double horizontal_sum(__m256d value)
+{
+	__m128d low = _mm_add_pd(_mm256_castpd256_pd128(value), _mm256_extractf128_pd(value, 1));
+	return _mm_cvtsd_f64(_mm_add_sd(low, _mm_unpackhi_pd(low, low)));
+}
+
+template <unsigned int R>
+__attribute__((target("avx2,fma"))) static void dense_avx2(const double *weights, const double *biases, const double *input, double *output, unsigned int cols, unsigned int row_begin, unsigned int row_end)
+{
+	unsigned int i = row_begin;
+	for (; i + R <= row_end; i += R)
+	{
+		__m256d sums[R];
+		for (unsigned int r = 0; r < R; r++)
+		{
+			sums[r] = _mm256_setzero_pd();
+		}
+
+		unsigned int j = 0;
+		for (; j + 4 <= cols; j += 4)
+		{
+			__m256d x = _mm256_loadu_pd(input + j);
+			for (unsigned int r = 0; r < R; r++)
+			{
+				sums[r] = _mm256_fmadd_pd(_mm256_loadu_pd(weights + (size_t)(i + r) * cols + j), x, sums[r]);
+			}
+		}
+
+		for (unsigned int r = 0; r < R; r++)
+		{
+			double sum = biases[i + r] + horizontal_sum(sums[r]);
+			for (unsigned int k = j; k < cols; k++)
+			{
+				sum += weights[(size_t)(i + r) * cols + k] * input[k];
+			}
+			output[i + r] = sum;
+		}
+	}
+
+	dense_scalar<1>(weights, biases, input, output, cols, i, row_end);
+}
+
+template <unsigned int R>
+__attribute__((target("avx512f"))) static void dense_avx512(const double *weights, const double *biases, const double *input, double *output, unsigned int cols, unsigned int row_begin, unsigned int row_end)
+{
+	unsigned int i = row_begin;
+	for (; i + R <= row_end; i += R)
+	{
+		__m512d sums[R];
+		for (unsigned int r = 0; r < R; r++)
+		{
+			sums[r] = _mm512_setzero_pd();
+		}
+
+		unsigned int j = 0;
+		for (; j + 8 <= cols; j += 8)
+		{
+			__m512d x = _mm512_loadu_pd(input + j);
+			for (unsigned int r = 0; r < R; r++)
+			{
+				sums[r] = _mm512_fmadd_pd(_mm512_loadu_pd(weights + (size_t)(i + r) * cols + j), x, sums[r]);
+			}
+		}
+
+		// Masked load for the tail keeps it vectorized
+		if (j < cols)
+		{
+			__mmask8 mask = (__mmask8)((1u << (cols - j)) - 1);
+			__m512d x = _mm512_maskz_loadu_pd(mask, input + j);
+			for (unsigned int r = 0; r < R; r++)
+			{
+				sums[r] = _mm512_fmadd_pd(_mm512_maskz_loadu_pd(mask, weights + (size_t)(i + r) * cols + j), x, sums[r]);
+			}
+		}
+
+		for (unsigned int r = 0; r < R; r++)
+		{
+			alignas(64) double lanes[8];
+			_mm512_store_pd(lanes, sums[r]);
+
+			double sum = biases[i + r];
+			for (unsigned int k = 0; k < 8; k++)
+			{
+				sum += lanes[k];
+			}
+			output[i + r] = sum;
+		}
+	}
+
+	dense_scalar<1>(weights, biases, input, output, cols, i, row_end);
+}
+#endif
+
+const std::vector<DenseKernel> &dense_kernels()
+{
+	static const std::vector<DenseKernel> kernels = []()
+	{
+		std::vector<DenseKernel> kernels = {
+			{"scalar", 1, 1, dense_scalar<1>},
+			{"scalar-r4", 1, 4, dense_scalar<4>},
+		};
+
+#ifdef KERNELS_X86
+		if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		{
+			kernels.push_back({"avx2", 4, 1, dense_avx2<1>});
+			kernels.push_back({"avx2-r4", 4, 4, dense_avx2<4>});
+		}
+		if (__builtin_cpu_supports("avx512f"))
+		{
+			kernels.push_back({"avx512", 8, 1, dense_avx512<1>});
+			kernels.push_back({"avx512-r4", 8, 4, dense_avx512<4>});
+		}
+#endif
+		return kernels;
+	}();
+	return kernels;
+}
+
+const DenseKernel *find_dense_kernel(const std::string &name)
+{
+	for (const DenseKernel &kernel : dense_kernels())
+	{
+		if (kernel.name == name)
+		{
+			return &kernel;
+		}
+	}
+	return nullptr;
+}
+
+void run_dense_kernel(const DenseKernel &kernel, const double *weights, const double *biases, const double *inputs, double *outputs, unsigned int rows, unsigned int cols, unsigned int batch, unsigned int num_threads)
+{
+	// Batches walk the rows in blocks that stay in cache while every sample uses them, so weights
+	// are read from memory once per batch rather than once per sample
+	unsigned int block = rows;
+	if (batch > 1)
+	{
+		size_t block_rows = DENSE_BLOCK_BYTES / (std::max(1u, cols) * sizeof(double));
+		block = std::max<size_t>(kernel.row_tile, block_rows / kernel.row_tile * kernel.row_tile);
+	}
+
+	auto run_rows = [&](unsigned int row_begin, unsigned int row_end)
+	{
+		for (unsigned int block_begin = row_begin; block_begin < row_end; block_begin += block)
+		{
+			unsigned int block_end = std::min(block_begin + block, row_end);
+			for (unsigned int b = 0; b < batch; b++)
+			{
+				kernel.function(weights, biases, inputs + (size_t)b * cols, outputs + (size_t)b * rows, cols, block_begin, block_end);
+			}
+		}
+	};
+
+	// Ranges are a multiple of the row tile so only the last one has a remainder
+	parallel_ranges(rows, num_threads, run_rows, kernel.row_tile);
+}
@@ -0,0 +1,31 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <string>
+#include <vector>
+
+// Computes the pre-activation outputs of rows [row_begin, row_end) of a dense layer for one sample:
+// output[i] = biases[i] + sum_j weights[i * cols + j] * input[j], with row-major weights.
+typedef void (*DenseKernelFunction)(const double *weights, const double *biases, const double *input, double *output, unsigned int cols, unsigned int row_begin, unsigned int row_end);
+
+// A dense layer kernel implementation.
+struct DenseKernel
+{
+	std::string name;             // Unique name, used as the key in tuning caches.
+	unsigned int vector_width;    // Doubles per SIMD register, 1 for scalar.
+	unsigned int row_tile;        // Rows computed together, sharing each input load.
+	DenseKernelFunction function; // The kernel.
+};
+
+// Get the dense kernels supported by this CPU. The first kernel is the scalar reference.
+const std::vector<DenseKernel> &dense_kernels();
+
+// Find a supported kernel by name, or return nullptr.
+const DenseKernel *find_dense_kernel(const std::string &name);
+
+// Run a kernel over a batch of row-major samples, splitting the rows across num_threads workers of
+// the shared team. Batches run every sample over one cache-sized block of rows before the next.
+// inputs holds batch x cols values and outputs batch x rows values.
+void run_dense_kernel(const DenseKernel &kernel, const double *weights, const double *biases, const double *inputs, double *outputs, unsigned int rows, unsigned int cols, unsigned int batch, unsigned int num_threads);
+
+#endif // KERNELS_H
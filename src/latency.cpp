@@ -0,0 +1,109 @@
+#include "latency.h"
+#include "gemm.h"
+
+#include <algorithm> // For min, max
+#include <stdexcept> // For runtime_error
+
+// Fewest rows given to a worker, smaller layers use fewer workers
+#define LATENCY_MIN_ROWS 16
+
+// Rows per dense kernel tile, worker ranges are a multiple of it
+#define LATENCY_ROW_TILE 4
+
+static unsigned int team_size(unsigned int num_threads)
+{
+	return num_threads != 0 ? num_threads : std::max(1u, std::thread::hardware_concurrency());
+}
+
+LatencyNetwork::LatencyNetwork(const Network &network, unsigned int num_threads) : input_size(network.inputSize()), team(team_size(num_threads))
+{
+	unsigned int workers = this->team.size();
+
+	this->layers.reserve(network.size());
+	for (unsigned int l = 0; l < network.size(); l++)
+	{
+		const Layer &layer = network.getLayer(l);
+		if (layer.getType() != LayerType::Dense)
+		{
+			throw std::runtime_error("Latency networks only support fully connected layers.");
+		}
+		std::span<const double> weights = layer.getWeights();
+		std::span<const double> biases = layer.getBiases();
+
+		DenseLayer dense;
+		dense.num_neurons = layer.size();
+		dense.num_inputs = layer.inputSize();
+		dense.weights.assign(weights.begin(), weights.end());
+		dense.biases.assign(biases.begin(), biases.end());
+		dense.activation = layer.getActivation();
+
+		// Equal row ranges in whole tiles, leaving workers idle rather than handing out slivers
+		unsigned int chunk = (dense.num_neurons + workers - 1) / workers;
+		chunk = std::max(chunk, (unsigned int)LATENCY_MIN_ROWS);
+		chunk = (chunk + LATENCY_ROW_TILE - 1) / LATENCY_ROW_TILE * LATENCY_ROW_TILE;
+
+		std::vector<unsigned int> split(workers + 1);
+		for (unsigned int w = 0; w <= workers; w++)
+		{
+			split[w] = std::min(w * chunk, dense.num_neurons);
+		}
+
+		this->splits.emplace_back(std::move(split));
+		this->values.emplace_back(dense.num_neurons);
+		this->layers.emplace_back(std::move(dense));
+	}
+}
+
+void LatencyNetwork::predict(std::span<const double> input, std::vector<double> &output)
+{
+	if (input.size() != this->input_size)
+	{
+		throw std::runtime_error("Input size does not match network input size.");
+	}
+
+	this->team.run([&](unsigned int worker)
+	{
+		const double *current_inputs = input.data();
+		for (size_t l = 0; l < this->layers.size(); l++)
+		{
+			const DenseLayer &layer = this->layers[l];
+			double *outputs = this->values[l].data();
+			unsigned int row_begin = this->splits[l][worker];
+			unsigned int row_end = this->splits[l][worker + 1];
+
+			gemv_rows(layer.weights.data(), layer.biases.data(), current_inputs, outputs, layer.num_inputs, row_begin, row_end);
+			for (unsigned int i = row_begin; i < row_end; i++)
+			{
+				outputs[i] = layer.activation.function(outputs[i]);
+			}
+
+			// Every row of this layer must be written before any worker reads it as input
+			bool last = l + 1 == this->layers.size();
+			if (!last || layer.activation.normalize)
+			{
+				this->team.barrier();
+			}
+
+			// Normalization needs the whole layer, worker 0 applies it while the others wait
+			if (layer.activation.normalize)
+			{
+				if (worker == 0)
+				{
+					layer.activation.normalize(outputs, layer.num_neurons);
+				}
+				if (!last)
+				{
+					this->team.barrier();
+				}
+			}
+			current_inputs = outputs;
+		}
+	});
+
+	output.assign(this->values.back().begin(), this->values.back().end());
+}
+
+unsigned int LatencyNetwork::threads() const
+{
+	return this->team.size();
+}
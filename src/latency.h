@@ -0,0 +1,34 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include "network.h"
+#include "dense.h"
+#include "team.h"
+
+#include <vector>
+#include <span>
+
+// Read-only inference copy of a network for low-latency single-sample prediction. Each layer's
+// output neurons are split across a persistent thread team, with a barrier between layers, so one
+// sample's forward pass runs on several cores.
+class LatencyNetwork
+{
+public:
+	// Compile a network for a team of num_threads threads, 0 for one per hardware thread.
+	LatencyNetwork(const Network &network, unsigned int num_threads = 0);
+
+	// Make a prediction for a single input. Not safe to call concurrently.
+	void predict(std::span<const double> input, std::vector<double> &output);
+
+	// Get the number of threads in the team.
+	unsigned int threads() const;
+
+private:
+	unsigned int input_size;                       // Number of inputs to the network.
+	std::vector<DenseLayer> layers;                // Layers in the network.
+	std::vector<std::vector<unsigned int>> splits; // First row of each worker per layer, plus the row count.
+	std::vector<std::vector<double>> values;       // Outputs of each layer.
+	ThreadTeam team;                               // Workers sharing each layer.
+};
+
+#endif // LATENCY_H
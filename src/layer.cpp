@@ -1,15 +1,61 @@
 #include "layer.h"
+#include "gemm.h"
 
 #include <stdexcept> // For runtime_error
+#include <algorithm> // For max, nth_element
+#include <cmath>     // For abs, nextafter
+#include <cfloat>    // For DBL_MIN
+#include <thread>
 
-Layer::Layer(unsigned int num_neurons, unsigned int num_inputs, Activation activation) : num_inputs(num_inputs), num_neurons(num_neurons), activation(activation)
+// Minimum number of weights before a layer is initialized in parallel
+#define PARALLEL_INITIALIZATION_THRESHOLD (1 << 18)
+
+// Minimum number of weights before a layer uses the blocked GEMM backend
+#define GEMM_THRESHOLD (1 << 16)
+
+Layer::Layer(unsigned int num_neurons, unsigned int num_inputs, Activation activation)
+	: num_neurons(num_neurons), num_inputs(num_inputs), activation(activation), type(LayerType::Dense), convolution(), pooling(), weight_rows(num_neurons), weight_cols(num_inputs), kernel(nullptr), kernel_threads(1)
 {
-	neurons.reserve(num_neurons);
-	for (int i = 0; i < this->num_neurons; i++)
+	this->weights.resize((size_t)num_neurons * num_inputs, 0.0);
+	this->biases.resize(num_neurons, 0.0);
+	this->values.resize(num_neurons, 0.0);
+}
+
+Layer::Layer(const Conv2D &convolution, Activation activation)
+	: num_neurons(0), num_inputs(convolution.channels * convolution.height * convolution.width), activation(activation), type(LayerType::Conv2D), convolution(convolution), pooling(),
+	  weight_rows(convolution.filters), weight_cols(convolution.channels * convolution.kernel * convolution.kernel), kernel(nullptr), kernel_threads(1)
+{
+	if (convolution.channels == 0 || convolution.filters == 0 || convolution.kernel == 0 || convolution.stride == 0)
+	{
+		throw std::runtime_error("Convolution sizes and stride must be positive.");
+	}
+	if (convolution.height + 2 * convolution.padding < convolution.kernel || convolution.width + 2 * convolution.padding < convolution.kernel)
 	{
-		Neuron neuron(this->num_inputs);
-		this->neurons.emplace_back(neuron);
+		throw std::runtime_error("Convolution kernel is larger than the padded input.");
 	}
+
+	this->num_neurons = convolution.filters * convolution.outputHeight() * convolution.outputWidth();
+	this->weights.resize((size_t)this->weight_rows * this->weight_cols, 0.0);
+	this->biases.resize(this->weight_rows, 0.0);
+	this->values.resize(this->num_neurons, 0.0);
+}
+
+Layer::Layer(const MaxPool2D &pooling)
+	: num_neurons(0), num_inputs(pooling.channels * pooling.height * pooling.width), activation(ActivationFunctions::linear), type(LayerType::MaxPool2D), convolution(), pooling(pooling),
+	  weight_rows(0), weight_cols(0), kernel(nullptr), kernel_threads(1)
+{
+	if (pooling.channels == 0 || pooling.size == 0 || pooling.stride == 0)
+	{
+		throw std::runtime_error("Pooling sizes and stride must be positive.");
+	}
+	if (pooling.height < pooling.size || pooling.width < pooling.size)
+	{
+		throw std::runtime_error("Pooling window is larger than the input.");
+	}
+
+	this->num_neurons = pooling.channels * pooling.outputHeight() * pooling.outputWidth();
+	this->values.resize(this->num_neurons, 0.0);
+	this->switches.resize(this->num_neurons, 0);
 }
 
 Layer::~Layer()
@@ -17,58 +63,92 @@ Layer::~Layer()
 	// Destructor, if necessary
 }
 
-Layer* Layer::initialize()
+Layer* Layer::initialize(Initialization initialization, uint64_t seed, unsigned int layer_index, unsigned int fan_out)
 {
-	for (Neuron &neuron : this->neurons)
+	this->mask.clear();
+	std::fill(this->values.begin(), this->values.end(), 0.0);
+
+	// A filter's outputs reach filters * kernel * kernel positions of the next layer's patches
+	if (this->type == LayerType::Conv2D)
 	{
-		neuron.initialize();
+		fan_out = this->convolution.filters * this->convolution.kernel * this->convolution.kernel;
 	}
-	return this;
-}
 
-Layer* Layer::initialize(const std::vector<double>& bias, const std::vector<std::vector<double>>& weights)
-{
-	if (bias.size() != this->num_neurons || weights.size() != this->num_neurons)
+	// Values depend only on the seed and the weight's position, the bias uses column weight_cols
+	auto initialize_range = [&](unsigned int begin, unsigned int end)
 	{
-		throw std::runtime_error("Input size does not match layer size.");
+		for (unsigned int i = begin; i < end; i++)
+		{
+			double *row = &this->weights[(size_t)i * this->weight_cols];
+			this->biases[i] = initial_weight(initialization, seed, layer_index, i, this->weight_cols, this->weight_cols, fan_out);
+			for (unsigned int j = 0; j < this->weight_cols; j++)
+			{
+				row[j] = initial_weight(initialization, seed, layer_index, i, j, this->weight_cols, fan_out);
+			}
+		}
+	};
+
+	// Small layers are not worth the thread start-up cost
+	unsigned int num_threads = std::max(1u, std::thread::hardware_concurrency());
+	if (this->weights.size() < PARALLEL_INITIALIZATION_THRESHOLD || num_threads == 1)
+	{
+		initialize_range(0, this->weight_rows);
+		return this;
 	}
 
-	for (int i = 0; i < this->num_neurons; i++)
+	num_threads = std::min(num_threads, this->weight_rows);
+	unsigned int chunk = (this->weight_rows + num_threads - 1) / num_threads;
+
+	std::vector<std::thread> threads;
+	threads.reserve(num_threads);
+	for (unsigned int begin = 0; begin < this->weight_rows; begin += chunk)
 	{
-		this->neurons[i].initialize(bias[i], weights[i]);
+		threads.emplace_back(initialize_range, begin, std::min(begin + chunk, this->weight_rows));
+	}
+	for (std::thread &thread : threads)
+	{
+		thread.join();
 	}
 	return this;
 }
 
+Layer* Layer::initialize(const std::vector<double>& bias, const std::vector<std::vector<double>>& weights)
+{
+	this->setWeightsBiases(bias, weights);
+	std::fill(this->values.begin(), this->values.end(), 0.0);
+	return this;
+}
+
 std::pair<std::vector<double>, std::vector<std::vector<double>>> Layer::getWeightsBiases() const
 {
-	std::vector<double> bias;
 	std::vector<std::vector<double>> weights;
+	weights.reserve(this->weight_rows);
 
-	bias.reserve(neurons.size());
-    weights.reserve(neurons.size());
-
-	for (const Neuron &neuron : this->neurons)
+	for (unsigned int i = 0; i < this->weight_rows; i++)
 	{
-		bias.emplace_back(neuron.getBias());
-		weights.emplace_back(neuron.getWeights());
+		std::span<const double> row = this->getWeights(i);
+		weights.emplace_back(row.begin(), row.end());
 	}
 
-	return std::make_pair(bias, weights);
+	return std::make_pair(this->biases, weights);
 }
 
 void Layer::setWeightsBiases(const std::vector<double>& bias, const std::vector<std::vector<double>>& weights)
 {
-	if (bias.size() != this->num_neurons || weights.size() != this->num_neurons)
+	if (bias.size() != this->weight_rows || weights.size() != this->weight_rows)
 	{
 		throw std::runtime_error("Input size does not match layer size.");
 	}
 
-	for (int i = 0; i < this->num_neurons; i++)
+	for (unsigned int i = 0; i < this->weight_rows; i++)
 	{
-		this->neurons[i].setBias(bias[i]);
-		this->neurons[i].setWeights(weights[i]);
+		if (weights[i].size() != this->weight_cols)
+		{
+			throw std::runtime_error("Input size does not match weight size.");
+		}
+		std::copy(weights[i].begin(), weights[i].end(), this->getWeights(i).begin());
 	}
+	this->biases = bias;
 }
 
 unsigned int Layer::size() const
@@ -76,28 +156,156 @@ unsigned int Layer::size() const
 	return this->num_neurons;
 }
 
-std::vector<double> Layer::getValues() const
+unsigned int Layer::inputSize() const
+{
+	return this->num_inputs;
+}
+
+Activation Layer::getActivation() const
+{
+	return this->activation;
+}
+
+LayerType Layer::getType() const
+{
+	return this->type;
+}
+
+const MaxPool2D &Layer::getPooling() const
+{
+	return this->pooling;
+}
+
+unsigned int Layer::weightRows() const
+{
+	return this->weight_rows;
+}
+
+std::span<double> Layer::getWeights()
+{
+	return this->weights;
+}
+
+std::span<const double> Layer::getWeights() const
+{
+	return this->weights;
+}
+
+std::span<double> Layer::getWeights(unsigned int row)
+{
+	return std::span<double>(this->weights).subspan((size_t)row * this->weight_cols, this->weight_cols);
+}
+
+std::span<const double> Layer::getWeights(unsigned int row) const
+{
+	return std::span<const double>(this->weights).subspan((size_t)row * this->weight_cols, this->weight_cols);
+}
+
+std::span<double> Layer::getBiases()
 {
-	std::vector<double> values;
-	values.reserve(this->num_neurons);
-	for (Neuron neuron : this->neurons)
+	return this->biases;
+}
+
+std::span<const double> Layer::getBiases() const
+{
+	return this->biases;
+}
+
+void Layer::setKernel(const DenseKernel *kernel, unsigned int num_threads)
+{
+	if (kernel && this->type != LayerType::Dense)
 	{
-		values.emplace_back(neuron.getValue());
+		throw std::runtime_error("Tuned kernels only apply to fully connected layers.");
 	}
-	return values;
+	this->kernel = kernel;
+	this->kernel_threads = num_threads;
 }
 
-void Layer::setValues(const std::vector<double> &values)
+size_t Layer::prune(double threshold)
 {
-	if (values.size() != this->num_neurons)
+	if (this->mask.empty())
 	{
-		throw std::runtime_error("Input size does not match layer size.");
+		this->mask.assign(this->weights.size(), 1.0);
 	}
 
-	for (int i = 0; i < this->num_neurons; i++)
+	size_t pruned = 0;
+	for (size_t i = 0; i < this->weights.size(); i++)
 	{
-		this->neurons[i].setValue(values[i]);
+		if (std::abs(this->weights[i]) < threshold)
+		{
+			this->weights[i] = 0.0;
+			this->mask[i] = 0.0;
+		}
+		pruned += this->mask[i] == 0.0;
+	}
+	return pruned;
+}
+
+size_t Layer::pruneToSparsity(double sparsity)
+{
+	if (sparsity < 0.0 || sparsity > 1.0)
+	{
+		throw std::runtime_error("Sparsity must be between 0 and 1.");
+	}
+
+	size_t total = this->weights.size();
+	size_t target = (size_t)(sparsity * total);
+	if (target == 0)
+	{
+		return this->prunedCount();
+	}
+
+	// Find the magnitude of the target-th smallest weight
+	std::vector<double> magnitudes;
+	magnitudes.reserve(total);
+	for (double weight : this->weights)
+	{
+		magnitudes.emplace_back(std::abs(weight));
+	}
+	std::nth_element(magnitudes.begin(), magnitudes.begin() + (target - 1), magnitudes.end());
+
+	// Prune everything up to and including that magnitude
+	return this->prune(std::nextafter(magnitudes[target - 1], INFINITY));
+}
+
+size_t Layer::prunedCount() const
+{
+	size_t pruned = 0;
+	for (double m : this->mask)
+	{
+		pruned += m == 0.0;
+	}
+	return pruned;
+}
+
+void Layer::clearMask()
+{
+	this->mask.clear();
+}
+
+std::span<const double> Layer::getMask() const
+{
+	return this->mask;
+}
+
+std::span<double> Layer::getValues()
+{
+	return this->values;
+}
+
+std::span<const double> Layer::getValues() const
+{
+	return this->values;
+}
+
+void Layer::setValues(std::span<const double> values)
+{
+	if (values.size() != this->num_neurons)
+	{
+		throw std::runtime_error("Input size does not match layer size.");
 	}
+
+	std::copy(values.begin(), values.end(), this->values.begin());
 }
 
 double Layer::computeLoss(const std::vector<double> &targets) const
@@ -108,69 +316,477 @@ double Layer::computeLoss(const std::vector<double> &targets) const
 	}
 
 	double loss = 0.0;
+	if (this->activation.normalize)
+	{
+		// Cross-entropy, using log(p_i) = z_i - log_sum_exp
+		for (unsigned int i = 0; i < this->num_neurons; i++)
+		{
+			loss -= targets[i] * (this->logits[i] - this->log_sum_exp);
+		}
+		return loss;
+	}
+
 	for (int i = 0; i < this->num_neurons; i++)
 	{
-		loss += std::pow(this->neurons[i].getValue() - targets[i], 2);
+		double error = this->values[i] - targets[i];
+		loss += error * error;
+	}
+	return loss / this->num_neurons;
+}
+
+double Layer::computeLoss(const std::vector<double> &outputs, const std::vector<double> &targets) const
+{
+	if (outputs.size() != this->num_neurons || targets.size() != this->num_neurons)
+	{
+		throw std::runtime_error("Input size does not match layer size.");
+	}
+
+	double loss = 0.0;
+	if (this->activation.normalize)
+	{
+		// Cross-entropy on probabilities, clamped so an underflowed output stays finite
+		for (unsigned int i = 0; i < this->num_neurons; i++)
+		{
+			loss -= targets[i] * std::log(std::max(outputs[i], DBL_MIN));
+		}
+		return loss;
+	}
+
+	for (unsigned int i = 0; i < this->num_neurons; i++)
+	{
+		double error = outputs[i] - targets[i];
+		loss += error * error;
 	}
 	return loss / this->num_neurons;
 }
 
-void Layer::computeDeltas(const std::vector<double> &targets)
+double Layer::computeDeltas(const std::vector<double> &targets)
 {
 	if (targets.size() != this->num_neurons)
 	{
 		throw std::runtime_error("Input size does not match layer size.");
 	}
 
-	std::vector<double> deltas(this->num_neurons, 0.0); // deltas for layer l
+	this->deltas.resize(this->num_neurons);
 
-	for (size_t i = 0; i < this->num_neurons; ++i)
+	if (this->activation.normalize)
 	{
-		double a = this->neurons[i].getValue();
-		deltas[i] = (a - targets[i]) * this->activation.derivative(a);
+		return softmax_cross_entropy(this->logits.data(), this->values.data(), targets.data(), this->log_sum_exp, this->deltas.data(), this->num_neurons);
 	}
 
-	this->deltas = deltas;
+	double loss = 0.0;
+	for (size_t i = 0; i < this->num_neurons; ++i)
+	{
+		double error = this->values[i] - targets[i];
+		this->deltas[i] = error * this->activation.derivative(this->values[i]);
+		loss += error * error;
+	}
+	return loss / this->num_neurons;
 }
 
 void Layer::computeDeltas(Layer &next_layer) // deltas for layer l + 1
 {
-	std::vector<double> deltas(this->num_neurons, 0.0); // deltas for layer l
+	if (this->activation.normalize)
+	{
+		throw std::runtime_error("Normalized activations are only supported on the output layer.");
+	}
 
-	for (int i = 0; i < this->num_neurons; i++)
+	// Only the next layer's deltas are read, so this layer's deltas are written in place
+	this->deltas.assign(this->num_neurons, 0.0);
+	next_layer.inputGradients(this->deltas.data());
+
+	for (unsigned int i = 0; i < this->num_neurons; i++)
+	{
+		this->deltas[i] *= this->activation.derivative(this->values[i]);
+	}
+}
+
+void Layer::inputGradients(double *sums) const
+{
+	if (this->type == LayerType::MaxPool2D)
+	{
+		// Only the maximum of each window passed its value on
+		for (unsigned int o = 0; o < this->num_neurons; o++)
+		{
+			sums[this->switches[o]] += this->deltas[o];
+		}
+		return;
+	}
+
+	if (this->type == LayerType::Conv2D)
+	{
+		// Gradient of every patch, folded back onto the input positions it was read from
+		size_t positions = this->num_neurons / this->weight_rows;
+		thread_local std::vector<double> columns;
+		columns.assign(positions * this->weight_cols, 0.0);
+
+		for (size_t p = 0; p < positions; p++)
+		{
+			double *column = &columns[p * this->weight_cols];
+			for (unsigned int f = 0; f < this->weight_rows; f++)
+			{
+				double delta = this->deltas[f * positions + p];
+				const double *row = &this->weights[(size_t)f * this->weight_cols];
+				for (unsigned int k = 0; k < this->weight_cols; k++)
+				{
+					column[k] += delta * row[k];
+				}
+			}
+		}
+		col2im(this->convolution, columns.data(), sums);
+		return;
+	}
+
+	// Row by row, so the weights stream contiguously
+	for (unsigned int i = 0; i < this->num_neurons; i++)
+	{
+		double delta = this->deltas[i];
+		const double *row = &this->weights[(size_t)i * this->num_inputs];
+		for (unsigned int j = 0; j < this->num_inputs; j++)
+		{
+			sums[j] += delta * row[j];
+		}
+	}
+}
+
+void Layer::weightedSums(const double *inputs, double *outputs) const
+{
+	if (this->kernel)
+	{
+		run_dense_kernel(*this->kernel, this->weights.data(), this->biases.data(), inputs, outputs, this->num_neurons, this->num_inputs, 1, this->kernel_threads);
+		return;
+	}
+	if (this->weights.size() >= GEMM_THRESHOLD)
+	{
+		gemv(this->weights.data(), this->biases.data(), inputs, outputs, this->num_neurons, this->num_inputs, gemm_threads(this->weights.size()));
+		return;
+	}
+
+	for (unsigned int i = 0; i < this->num_neurons; i++)
+	{
+		const double *row = &this->weights[(size_t)i * this->num_inputs];
+		double weighted_sum = this->biases[i];
+		for (unsigned int j = 0; j < this->num_inputs; j++)
+		{
+			weighted_sum += inputs[j] * row[j];
+		}
+		outputs[i] = weighted_sum;
+	}
+}
+
+void Layer::convolve(const double *inputs, double *outputs) const
+{
+	size_t positions = this->num_neurons / this->weight_rows;
+
+	if (this->convolution.kernel == 3 && this->convolution.stride == 1)
+	{
+		convolve_3x3(this->convolution, this->weights.data(), inputs, outputs);
+	}
+	else
+	{
+		// The patches take the place of the weight matrix and the filters that of the samples, so the
+		// products come out filter by filter, already in CHW order
+		thread_local std::vector<double> columns;
+		thread_local std::vector<double> zeros;
+		thread_local PackedWeights packed;
+
+		columns.resize(positions * this->weight_cols);
+		zeros.assign(positions, 0.0);
+		im2col(this->convolution, inputs, columns.data());
+		pack_weights(columns.data(), positions, this->weight_cols, packed);
+		gemm(packed, zeros.data(), this->weights.data(), outputs, this->weight_rows, gemm_threads(columns.size() * this->weight_rows));
+	}
+
+	for (unsigned int f = 0; f < this->weight_rows; f++)
+	{
+		double *plane = outputs + f * positions;
+		for (size_t p = 0; p < positions; p++)
+		{
+			plane[p] += this->biases[f];
+		}
+	}
+}
+
+void Layer::compute(const double *inputs, double *outputs, unsigned int *switches) const
+{
+	switch (this->type)
+	{
+	case LayerType::Conv2D:
+		this->convolve(inputs, outputs);
+		break;
+	case LayerType::MaxPool2D:
+		max_pool(this->pooling, inputs, outputs, switches);
+		break;
+	case LayerType::Dense:
+	default:
+		this->weightedSums(inputs, outputs);
+		break;
+	}
+}
+
+void Layer::activate(double *outputs) const
+{
+	for (unsigned int i = 0; i < this->num_neurons; i++)
+	{
+		outputs[i] = this->activation.function(outputs[i]);
+	}
+}
+
+std::span<const double> Layer::forward(std::span<const double> inputs)
+{
+	if (inputs.size() != this->num_inputs)
+	{
+		throw std::runtime_error("Input size does not match weight size.");
+	}
+
+	this->compute(inputs.data(), this->values.data(), this->switches.data());
+	this->activate(this->values.data());
+
+	if (this->activation.normalize)
+	{
+		this->logits = this->values;
+		this->log_sum_exp = this->activation.normalize(this->values.data(), this->num_neurons);
+	}
+	return this->values;
+}
+
+void Layer::forward(std::span<const double> inputs, std::vector<double> &outputs) const
+{
+	if (inputs.size() != this->num_inputs)
+	{
+		throw std::runtime_error("Input size does not match weight size.");
+	}
+
+	outputs.resize(this->num_neurons);
+	this->compute(inputs.data(), outputs.data(), nullptr);
+	this->activate(outputs.data());
+
+	if (this->activation.normalize)
+	{
+		this->activation.normalize(outputs.data(), outputs.size());
+	}
+}
+
+void Layer::forward(std::span<const double> inputs, std::vector<double> &outputs, unsigned int batch) const
+{
+	if (inputs.size() != (size_t)batch * this->num_inputs)
+	{
+		throw std::runtime_error("Input size does not match weight size.");
+	}
+
+	outputs.resize((size_t)batch * this->num_neurons);
+	if (this->type == LayerType::Dense && this->weights.size() >= GEMM_THRESHOLD && batch > 1)
 	{
-		double delta = 0.0;
-		for (int j = 0; j < next_layer.size(); j++)
+		// Packing reads the weights once per batch, after which every panel is reused across samples
+		thread_local PackedWeights packed;
+		pack_weights(this->weights.data(), this->num_neurons, this->num_inputs, packed);
+		gemm(packed, this->biases.data(), inputs.data(), outputs.data(), batch, gemm_threads(this->weights.size() * batch));
+	}
+	else
+	{
+		for (unsigned int b = 0; b < batch; b++)
+		{
+			this->compute(inputs.data() + (size_t)b * this->num_inputs, outputs.data() + (size_t)b * this->num_neurons, nullptr);
+		}
+	}
+
+	for (unsigned int b = 0; b < batch; b++)
+	{
+		double *sample = outputs.data() + (size_t)b * this->num_neurons;
+		this->activate(sample);
+		if (this->activation.normalize)
+		{
+			this->activation.normalize(sample, this->num_neurons);
+		}
+	}
+}
+
+std::span<const double> Layer::backward(std::span<const double> inputs, double learning_rate)
+{
+	if (inputs.size() != this->num_inputs)
+	{
+		throw std::runtime_error("Input size does not match layer size.");
+	}
+
+	if (this->type != LayerType::Dense)
+	{
+		// Shared weights get one gradient summed over every output position
+		thread_local std::vector<double> gradient;
+		gradient.assign((size_t)this->weight_rows * (this->weight_cols + 1), 0.0);
+		this->weightGradients(inputs.data(), gradient.data());
+		this->applyGradient(gradient.data(), learning_rate);
+		return this->values;
+	}
+
+	if (this->weights.size() >= GEMM_THRESHOLD)
+	{
+		thread_local std::vector<double> steps;
+		steps.resize(this->num_neurons);
+		for (unsigned int i = 0; i < this->num_neurons; i++)
 		{
-			delta += next_layer.deltas[j] * next_layer.neurons[j].getWeights()[i];
+			steps[i] = learning_rate * this->deltas[i];
+			this->biases[i] -= steps[i];
 		}
-		deltas[i] = delta * this->activation.derivative(this->neurons[i].getValue());
+
+		const double *mask = this->mask.empty() ? nullptr : this->mask.data();
+		rank_one_update(this->weights.data(), mask, steps.data(), inputs.data(), this->num_neurons, this->num_inputs, gemm_threads(this->weights.size()));
+		return this->values;
 	}
 
-	this->deltas = deltas;
+	for (unsigned int i = 0; i < this->num_neurons; i++)
+	{
+		double step = learning_rate * this->deltas[i];
+		double *row = &this->weights[(size_t)i * this->num_inputs];
+
+		this->biases[i] -= step;
+		if (this->mask.empty())
+		{
+			for (unsigned int j = 0; j < this->num_inputs; j++)
+			{
+				row[j] -= step * inputs[j];
+			}
+		}
+		else
+		{
+			// Multiplying by the mask keeps the loop branch-free
+			const double *mask = &this->mask[(size_t)i * this->num_inputs];
+			for (unsigned int j = 0; j < this->num_inputs; j++)
+			{
+				row[j] -= step * inputs[j] * mask[j];
+			}
+		}
+	}
+	return this->values;
 }
 
-std::vector<double> Layer::forward(const std::vector<double> &inputs)
+void Layer::backward(Layer &previous_layer, double learning_rate)
 {
-	std::vector<double> outputs;
-	outputs.reserve(this->num_neurons);
-	for (Neuron &neuron : this->neurons)
+	if (previous_layer.activation.normalize)
+	{
+		throw std::runtime_error("Normalized activations are only supported on the output layer.");
+	}
+	if (previous_layer.num_neurons != this->num_inputs)
+	{
+		throw std::runtime_error("Input size does not match layer size.");
+	}
+
+	if (this->type != LayerType::Dense)
+	{
+		// The input gradients read the weights before the update
+		previous_layer.computeDeltas(*this);
+		this->backward(previous_layer.values, learning_rate);
+		return;
+	}
+
+	for (unsigned int i = 0; i < this->num_neurons; i++)
+	{
+		this->biases[i] -= learning_rate * this->deltas[i];
+	}
+
+	// Sum W^T * delta into the previous layer's deltas with the weights before this update
+	std::vector<double> &sums = previous_layer.deltas;
+	sums.assign(previous_layer.num_neurons, 0.0);
+
+	const double *mask = this->mask.empty() ? nullptr : this->mask.data();
+	backward_update(this->weights.data(), mask, this->deltas.data(), learning_rate, previous_layer.values.data(), sums.data(), this->num_neurons, this->num_inputs, gemm_threads(this->weights.size()));
+
+	for (unsigned int j = 0; j < previous_layer.num_neurons; j++)
 	{
-		outputs.emplace_back(neuron.activate(inputs, this->activation));
+		sums[j] *= previous_layer.activation.derivative(previous_layer.values[j]);
 	}
-	return outputs;
 }
 
-std::vector<double> Layer::backward(const std::vector<double> &inputs, double learning_rate)
+void Layer::accumulateGradients(std::span<const double> inputs)
 {
 	if (inputs.size() != this->num_inputs)
 	{
 		throw std::runtime_error("Input size does not match layer size.");
 	}
 
-	for (int i = 0; i < this->num_neurons; i++)
+	this->gradients.resize((size_t)this->weight_rows * (this->weight_cols + 1), 0.0);
+	this->weightGradients(inputs.data(), this->gradients.data());
+}
+
+void Layer::weightGradients(const double *inputs, double *gradient) const
+{
+	size_t stride = this->weight_cols + 1;
+
+	if (this->type == LayerType::Conv2D)
+	{
+		// Sum over output positions of delta times the patch each position read
+		size_t positions = this->num_neurons / this->weight_rows;
+		thread_local std::vector<double> columns;
+		columns.resize(positions * this->weight_cols);
+		im2col(this->convolution, inputs, columns.data());
+
+		for (unsigned int f = 0; f < this->weight_rows; f++)
+		{
+			const double *deltas = &this->deltas[f * positions];
+			double *row = &gradient[f * stride];
+			for (size_t p = 0; p < positions; p++)
+			{
+				const double *column = &columns[p * this->weight_cols];
+				row[0] += deltas[p];
+				for (unsigned int k = 0; k < this->weight_cols; k++)
+				{
+					row[k + 1] += deltas[p] * column[k];
+				}
+			}
+		}
+		return;
+	}
+
+	// Pooling layers have no weight rows
+	for (unsigned int i = 0; i < this->weight_rows; i++)
+	{
+		double delta = this->deltas[i];
+		double *row = &gradient[i * stride];
+
+		row[0] += delta;
+		for (unsigned int j = 0; j < this->weight_cols; j++)
+		{
+			row[j + 1] += delta * inputs[j];
+		}
+	}
+}
+
+std::vector<double> &Layer::getGradients()
+{
+	this->gradients.resize((size_t)this->weight_rows * (this->weight_cols + 1), 0.0);
+	return this->gradients;
+}
+
+void Layer::applyGradients(double learning_rate)
+{
+	this->gradients.resize((size_t)this->weight_rows * (this->weight_cols + 1), 0.0);
+	this->applyGradient(this->gradients.data(), learning_rate);
+	std::fill(this->gradients.begin(), this->gradients.end(), 0.0);
+}
+
+void Layer::applyGradient(const double *gradient, double learning_rate)
+{
+	size_t stride = this->weight_cols + 1;
+
+	for (unsigned int i = 0; i < this->weight_rows; i++)
 	{
-		this->neurons[i].updateWeightsBias(learning_rate, this->deltas[i], inputs);
+		const double *row_gradient = &gradient[i * stride];
+		double *row = &this->weights[(size_t)i * this->weight_cols];
+
+		this->biases[i] -= learning_rate * row_gradient[0];
+		if (this->mask.empty())
+		{
+			for (unsigned int j = 0; j < this->weight_cols; j++)
+			{
+				row[j] -= learning_rate * row_gradient[j + 1];
+			}
+		}
+		else
+		{
+			const double *mask = &this->mask[(size_t)i * this->weight_cols];
+			for (unsigned int j = 0; j < this->weight_cols; j++)
+			{
+				row[j] -= learning_rate * row_gradient[j + 1] * mask[j];
+			}
+		}
 	}
-	return this->getValues();
-}
\ No newline at end of file
+}
@@ -1,19 +1,30 @@
 #ifndef LAYER_H
 #define LAYER_H
 
-#include "neuron.h"
 #include "activation.h"
+#include "convolution.h"
+#include "kernels.h"
+#include "random.h"
 
 #include <vector>
+#include <span>
 
 class Layer
 {
 public:
 	Layer(unsigned int num_neurons, unsigned int num_inputs, Activation activation);
+
+	// Convolution layer, with one neuron per filter and output position and the weights shared
+	// across positions. Small 3x3 filters use a direct kernel, others im2col and the GEMM backend.
+	Layer(const Conv2D &convolution, Activation activation);
+
+	// Max pooling layer, which has no weights.
+	Layer(const MaxPool2D &pooling);
 	~Layer();
 
-	// Initialize the neurons in the layer.
-	Layer* initialize();
+	// Initialize the neurons in the layer with random values. Large layers are initialized in
+	// parallel, with identical results for any thread count.
+	Layer* initialize(Initialization initialization, uint64_t seed, unsigned int layer_index, unsigned int fan_out);
 
 	// Initialize the neurons in the layer with custom weights and biases.
 	Layer* initialize(const std::vector<double>& bias, const std::vector<std::vector<double>>& weights);
@@ -27,34 +38,152 @@ public:
 	// Get the number of neurons in the layer.
 	unsigned int size() const;
 
-	// Get the values of the neurons in the layer.
-	std::vector<double> getValues() const;
+	// Get the number of inputs to each neuron.
+	unsigned int inputSize() const;
+
+	// Get the activation function of the layer.
+	Activation getActivation() const;
+
+	// Get the kind of layer.
+	LayerType getType() const;
+
+	// Get the shape of a pooling layer.
+	const MaxPool2D &getPooling() const;
+
+	// Get the number of weight rows: one per neuron of a dense layer, one per filter of a
+	// convolution and none for pooling.
+	unsigned int weightRows() const;
+
+	// Get a view of the layer's weights, row-major with inputSize() weights per neuron, or
+	// channels * kernel * kernel weights per filter of a convolution.
+	// Pruned weights written through the view are not re-masked, but their updates stay masked.
+	std::span<double> getWeights();
+	std::span<const double> getWeights() const;
+
+	// Get a view of one weight row.
+	std::span<double> getWeights(unsigned int row);
+	std::span<const double> getWeights(unsigned int row) const;
+
+	// Get a view of the biases, one per weight row.
+	std::span<double> getBiases();
+	std::span<const double> getBiases() const;
+
+	// Compute the weighted sums of a dense layer with a tuned kernel and thread count, or with the
+	// default backend when kernel is nullptr.
+	void setKernel(const DenseKernel *kernel, unsigned int num_threads);
+
+	// Zero and mask weights with magnitude below the threshold. Returns the number of pruned weights.
+	size_t prune(double threshold);
+
+	// Prune the smallest magnitude weights until the given fraction of weights is zero.
+	// Returns the number of pruned weights.
+	size_t pruneToSparsity(double sparsity);
+
+	// Get the number of pruned weights.
+	size_t prunedCount() const;
+
+	// Forget the pruning mask, so every weight is trained again.
+	void clearMask();
+
+	// Get a view of the pruning mask, laid out like the weights with 0 for pruned weights and 1
+	// otherwise. Empty if the layer was never pruned.
+	std::span<const double> getMask() const;
+
+	// Get a view of the neuron values from the last forward pass.
+	std::span<double> getValues();
+	std::span<const double> getValues() const;
 
 	// Set the values of the neurons in the layer.
-	void setValues(const std::vector<double> &values);
+	void setValues(std::span<const double> values);
 
 	// Compute loss for the layer.
 	double computeLoss(const std::vector<double> &targets) const;
 
+	// Compute loss for the given outputs of this layer without using the layer state.
+	double computeLoss(const std::vector<double> &outputs, const std::vector<double> &targets) const;
+
 	// Compute the deltas for the current layer (l) based on the next layer (l + 1).
 	void computeDeltas(Layer &next_layer);
 
-	// Set deltas for the last layer using the target values.
-	void computeDeltas(const std::vector<double> &targets);
+	// Set deltas for the last layer using the target values and return the loss.
+	// Softmax layers use the fused cross-entropy kernel, other layers use mean squared error.
+	double computeDeltas(const std::vector<double> &targets);
 
-	// Forward pass through the layer.
-	std::vector<double> forward(const std::vector<double> &inputs);
+	// Forward pass through the layer. Returns a view of the layer's values.
+	std::span<const double> forward(std::span<const double> inputs);
 
-	// Backward pass through the layer to update weights and biases.
-	std::vector<double> backward(const std::vector<double> &inputs, double learning_rate);
+	// Forward pass without modifying the layer state, writing into the outputs buffer.
+	void forward(std::span<const double> inputs, std::vector<double> &outputs) const;
+
+	// Forward pass for a batch of row-major samples without modifying the layer state. Large layers
+	// use the packed GEMM backend.
+	void forward(std::span<const double> inputs, std::vector<double> &outputs, unsigned int batch) const;
+
+	// Backward pass through the layer to update weights and biases. Returns a view of the layer's
+	// values, which are the inputs of the next layer.
+	std::span<const double> backward(std::span<const double> inputs, double learning_rate);
+
+	// Fused backward step for a layer above the first: compute the previous layer's deltas (W^T * delta)
+	// and update this layer's weights and biases in the same sweep, so each weight is read once.
+	// The previous layer's values are this layer's inputs.
+	void backward(Layer &previous_layer, double learning_rate);
+
+	// Add this sample's gradient (from the current deltas) to the accumulated gradients.
+	void accumulateGradients(std::span<const double> inputs);
+
+	// Get the accumulated gradients, laid out per weight row as [bias, weights...].
+	std::vector<double> &getGradients();
+
+	// Apply the accumulated gradients and reset them to zero.
+	void applyGradients(double learning_rate);
 
 private:
 	unsigned int num_neurons;       // Number of neurons in the layer.
 	unsigned int num_inputs;        // Number of inputs to each neuron.
-	std::vector<Neuron> neurons;    // Neurons in the layer.
 	Activation activation;          // Activation function for the layer.
 
+	LayerType type;                 // Kind of layer.
+	Conv2D convolution;             // Shape of a convolution layer.
+	MaxPool2D pooling;              // Shape of a pooling layer.
+	unsigned int weight_rows;       // Rows of the weight matrix.
+	unsigned int weight_cols;       // Columns of the weight matrix.
+	const DenseKernel *kernel;      // Tuned kernel of the weighted sums, nullptr for the default backend.
+	unsigned int kernel_threads;    // Thread count of the tuned kernel.
+
+	std::vector<double> weights;    // Weights, weight_rows x weight_cols.
+	std::vector<double> biases;     // Bias of each weight row.
+	std::vector<double> values;     // Output of each neuron's activation function.
+	std::vector<double> mask;       // 0 for pruned weights and 1 otherwise, empty if never pruned.
+
 	std::vector<double> deltas;     // Deltas for the layer.
+	std::vector<double> gradients;  // Accumulated gradients, weight_rows x (weight_cols + 1).
+	std::vector<unsigned int> switches; // Input index of each pooled maximum in the last forward pass.
+
+	std::vector<double> logits;     // Pre-normalization outputs, kept for normalized activations.
+	double log_sum_exp;             // Log of the normalizing constant of the last forward pass.
+
+	// Compute the weighted sums of one sample, using the tuned kernel if one is set and the GEMV
+	// backend for large layers otherwise.
+	void weightedSums(const double *inputs, double *outputs) const;
+
+	// Compute the filter responses of one sample, with biases.
+	void convolve(const double *inputs, double *outputs) const;
+
+	// Compute the pre-activation outputs of one sample for any kind of layer. switches may be
+	// nullptr, or receives the pooling switches.
+	void compute(const double *inputs, double *outputs, unsigned int *switches) const;
+
+	// Add the gradient with respect to this layer's inputs (W^T * delta for dense layers) to sums.
+	void inputGradients(double *sums) const;
+
+	// Add the weight gradient of one sample to gradient, laid out as the accumulated gradients.
+	void weightGradients(const double *inputs, double *gradient) const;
+
+	// Apply a gradient laid out as the accumulated gradients, skipping pruned weights.
+	void applyGradient(const double *gradient, double learning_rate);
+
+	// Apply the activation function to the weighted sums of one sample.
+	void activate(double *outputs) const;
 };
 
 #endif // LAYER_H
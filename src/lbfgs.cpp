@@ -0,0 +1,491 @@
+#include "lbfgs.h"
+#include "team.h"
+
+#include <cstdio>
+#include <cmath>     // For sqrt, abs, copysign
+#include <algorithm> // For min, max, fill, copy
+#include <stdexcept> // For runtime_error
+#include <atomic>
+#include <thread>
+#include <span>
+#include <vector>
+
+// Number of dataset shards whose gradients are summed in order, independent of the thread count
+#define LBFGS_GRADIENT_SHARDS 32
+
+// Sufficient decrease and curvature constants of the strong Wolfe conditions
+#define LBFGS_WOLFE_DECREASE 1e-4
+#define LBFGS_WOLFE_CURVATURE 0.9
+
+// Helper function to get the number of parameters, one bias and the weights of each weight row
+static size_t parameter_count(const Network &network)
+{
+	size_t count = 0;
+	for (unsigned int l = 0; l < network.size(); l++)
+	{
+		const Layer &layer = network.getLayer(l);
+		count += layer.getBiases().size() + layer.getWeights().size();
+	}
+	return count;
+}
+
+// Helper function to copy the parameters out of the network, laid out like the accumulated gradients
+static void get_parameters(const Network &network, std::vector<double> &parameters)
+{
+	double *cursor = parameters.data();
+	for (unsigned int l = 0; l < network.size(); l++)
+	{
+		const Layer &layer = network.getLayer(l);
+		std::span<const double> biases = layer.getBiases();
+		for (unsigned int i = 0; i < layer.weightRows(); i++)
+		{
+			std::span<const double> row = layer.getWeights(i);
+			*cursor++ = biases[i];
+			cursor = std::copy(row.begin(), row.end(), cursor);
+		}
+	}
+}
+
+// Helper function to copy parameters laid out like the accumulated gradients into the network
+static void set_parameters(Network &network, const std::vector<double> &parameters)
+{
+	const double *cursor = parameters.data();
+	for (unsigned int l = 0; l < network.size(); l++)
+	{
+		Layer &layer = network.getLayer(l);
+		std::span<double> biases = layer.getBiases();
+		for (unsigned int i = 0; i < layer.weightRows(); i++)
+		{
+			std::span<double> row = layer.getWeights(i);
+			biases[i] = *cursor++;
+			std::copy(cursor, cursor + row.size(), row.begin());
+			cursor += row.size();
+		}
+	}
+}
+
+// Helper function to get the pruning masks laid out like the accumulated gradients, with biases always
+// free. Empty when no layer is pruned.
+static std::vector<double> parameter_mask(const Network &network)
+{
+	bool pruned = false;
+	for (unsigned int l = 0; l < network.size(); l++)
+	{
+		pruned = pruned || !network.getLayer(l).getMask().empty();
+	}
+	if (!pruned)
+	{
+		return {};
+	}
+
+	std::vector<double> mask(parameter_count(network), 1.0);
+	double *cursor = mask.data();
+	for (unsigned int l = 0; l < network.size(); l++)
+	{
+		const Layer &layer = network.getLayer(l);
+		std::span<const double> layer_mask = layer.getMask();
+		for (unsigned int i = 0; i < layer.weightRows(); i++)
+		{
+			size_t row_size = layer.getWeights(i).size();
+			cursor++;
+			if (!layer_mask.empty())
+			{
+				std::copy(layer_mask.begin() + (size_t)i * row_size, layer_mask.begin() + (size_t)(i + 1) * row_size, cursor);
+			}
+			cursor += row_size;
+		}
+	}
+	return mask;
+}
+
+// Helper function to get the dot product of two vectors
+static double dot(const double *a, const double *b, size_t size)
+{
+	double sum = 0.0;
+	for (size_t i = 0; i < size; i++)
+	{
+		sum += a[i] * b[i];
+	}
+	return sum;
+}
+
+// Helper function to get the minimizer of the cubic matching value and slope at a and b. Falls back
+// to bisection when the cubic has no minimizer well inside the interval.
+static double cubic_minimizer(double a, double fa, double da, double b, double fb, double db)
+{
+	double d1 = da + db - 3 * (fa - fb) / (a - b);
+	double square = d1 * d1 - da * db;
+	double middle = (a + b) / 2;
+	if (square < 0.0)
+	{
+		return middle;
+	}
+
+	double d2 = std::copysign(std::sqrt(square), b - a);
+	double x = b - (b - a) * (db + d2 - d1) / (db - da + 2 * d2);
+
+	double low = std::min(a, b);
+	double high = std::max(a, b);
+	double margin = 0.1 * (high - low);
+	return x >= low + margin && x <= high - margin ? x : middle;
+}
+
+// Full-dataset objective and gradient on per-thread network copies.
+class FullBatchGradient
+{
+public:
+	FullBatchGradient(const Network &network, const Dataset &training, unsigned int num_threads)
+		: training(training), num_parameters(parameter_count(network)), mask(parameter_mask(network))
+	{
+		size_t num_shards = std::min<size_t>(LBFGS_GRADIENT_SHARDS, training.size());
+		this->shard_gradients.assign(num_shards, std::vector<double>(this->num_parameters));
+		this->shard_losses.assign(num_shards, 0.0);
+
+		// Squared error deltas omit the 2 / outputs factor of the mean squared error
+		const Layer &output = network.getLayer(network.size() - 1);
+		this->loss_scale = output.getActivation().normalize ? 1.0 : output.size() / 2.0;
+
+		if (num_threads == 0)
+		{
+			num_threads = std::max(1u, std::thread::hardware_concurrency());
+		}
+		num_threads = std::min<size_t>(num_threads, num_shards);
+
+		// Copies only ever hold the weights under evaluation, and must not share the profiler
+		this->replicas.assign(num_threads, network);
+		for (Network &replica : this->replicas)
+		{
+			replica.setProfiler(nullptr);
+		}
+	}
+
+	// Evaluate the mean objective and its gradient at the given parameters.
+	double evaluate(const std::vector<double> &parameters, std::vector<double> &gradient)
+	{
+		std::atomic<size_t> next_shard(0);
+		size_t num_shards = this->shard_gradients.size();
+
+		auto worker = [&](unsigned int thread)
+		{
+			WorkerScope scope(this->replicas.size() > 1);
+			Network &replica = this->replicas[thread];
+			set_parameters(replica, parameters);
+
+			for (size_t shard = next_shard++; shard < num_shards; shard = next_shard++)
+			{
+				for (unsigned int l = 0; l < replica.size(); l++)
+				{
+					std::vector<double> &layer_gradients = replica.getGradients(l);
+					std::fill(layer_gradients.begin(), layer_gradients.end(), 0.0);
+				}
+
+				size_t begin = shard * this->training.size() / num_shards;
+				size_t end = (shard + 1) * this->training.size() / num_shards;
+				double loss = 0.0;
+				for (size_t i = begin; i < end; i++)
+				{
+					loss += replica.accumulateGradients(this->training.inputs[i], this->training.targets[i]);
+				}
+				this->shard_losses[shard] = loss;
+
+				double *cursor = this->shard_gradients[shard].data();
+				for (unsigned int l = 0; l < replica.size(); l++)
+				{
+					const std::vector<double> &layer_gradients = replica.getGradients(l);
+					cursor = std::copy(layer_gradients.begin(), layer_gradients.end(), cursor);
+				}
+			}
+		};
+
+		std::vector<std::thread> threads;
+		threads.reserve(this->replicas.size() - 1);
+		for (unsigned int t = 1; t < this->replicas.size(); t++)
+		{
+			threads.emplace_back(worker, t);
+		}
+		worker(0);
+		for (std::thread &thread : threads)
+		{
+			thread.join();
+		}
+
+		// Shards are summed in order so the result does not depend on scheduling
+		double loss = 0.0;
+		std::fill(gradient.begin(), gradient.end(), 0.0);
+		for (size_t shard = 0; shard < num_shards; shard++)
+		{
+			const double *shard_gradient = this->shard_gradients[shard].data();
+			for (size_t i = 0; i < this->num_parameters; i++)
+			{
+				gradient[i] += shard_gradient[i];
+			}
+			loss += this->shard_losses[shard];
+		}
+
+		double scale = 1.0 / this->training.size();
+		for (double &value : gradient)
+		{
+			value *= scale;
+		}
+
+		// Pruned weights get no gradient, so directions built from it never move them off zero
+		if (!this->mask.empty())
+		{
+			for (size_t i = 0; i < this->num_parameters; i++)
+			{
+				gradient[i] *= this->mask[i];
+			}
+		}
+		return loss * this->loss_scale * scale;
+	}
+
+private:
+	const Dataset &training;                          // Samples of the objective.
+	size_t num_parameters;                            // Biases and weights of the network.
+	std::vector<double> mask;                         // Pruning mask of the parameters, empty if none are pruned.
+	double loss_scale;                                // Converts sample losses to the differentiated objective.
+	std::vector<Network> replicas;                    // Network copy of each thread.
+	std::vector<std::vector<double>> shard_gradients; // Summed gradient of each shard.
+	std::vector<double> shard_losses;                 // Summed loss of each shard.
+};
+
+LbfgsReport train_lbfgs(Network &network, const Dataset &training, const LbfgsOptions &options)
+{
+	if (training.inputs.size() != training.targets.size())
+	{
+		throw std::runtime_error("Input and target data have different sizes.");
+	}
+	if (training.size() == 0 || network.size() == 0)
+	{
+		throw std::runtime_error("Cannot train an empty network or dataset.");
+	}
+	if (options.history == 0)
+	{
+		throw std::runtime_error("L-BFGS history must hold at least one pair.");
+	}
+
+	FullBatchGradient objective(network, training, options.num_threads);
+	size_t n = parameter_count(network);
+
+	LbfgsReport report = {0, 0, 0.0, 0.0, false};
+
+	// Current point, trial point of the line search and best sufficient-decrease point seen
+	std::vector<double> x(n), g(n), x_trial(n), g_trial(n), x_best(n), g_best(n), direction(n);
+	get_parameters(network, x);
+	double f = objective.evaluate(x, g);
+	report.evaluations++;
+
+	// History pairs s = x_new - x and y = g_new - g, slot k at offset k * n, oldest first from start
+	unsigned int capacity = options.history;
+	std::vector<double> s_history((size_t)capacity * n), y_history((size_t)capacity * n);
+	std::vector<double> rho(capacity), alpha(capacity);
+	unsigned int start = 0;
+	unsigned int count = 0;
+
+	while (report.iterations < options.max_iterations)
+	{
+		double gradient_norm = std::sqrt(dot(g.data(), g.data(), n));
+		double x_norm = std::sqrt(dot(x.data(), x.data(), n));
+		if (f <= options.target_loss || gradient_norm <= options.gradient_tolerance * std::max(1.0, x_norm))
+		{
+			report.converged = true;
+			break;
+		}
+
+		// Two-loop recursion: direction = -H * g with the history's inverse Hessian estimate
+		std::copy(g.begin(), g.end(), direction.begin());
+		for (unsigned int j = count; j-- > 0;)
+		{
+			unsigned int k = (start + j) % capacity;
+			alpha[k] = rho[k] * dot(&s_history[(size_t)k * n], direction.data(), n);
+			const double *y = &y_history[(size_t)k * n];
+			for (size_t i = 0; i < n; i++)
+			{
+				direction[i] -= alpha[k] * y[i];
+			}
+		}
+		if (count > 0)
+		{
+			unsigned int newest = (start + count - 1) % capacity;
+			const double *y = &y_history[(size_t)newest * n];
+			double gamma = 1.0 / (rho[newest] * dot(y, y, n));
+			for (double &value : direction)
+			{
+				value *= gamma;
+			}
+		}
+		for (unsigned int j = 0; j < count; j++)
+		{
+			unsigned int k = (start + j) % capacity;
+			double beta = rho[k] * dot(&y_history[(size_t)k * n], direction.data(), n);
+			const double *s = &s_history[(size_t)k * n];
+			for (size_t i = 0; i < n; i++)
+			{
+				direction[i] += s[i] * (alpha[k] - beta);
+			}
+		}
+		for (double &value : direction)
+		{
+			value = -value;
+		}
+
+		// Fall back to steepest descent if the estimate lost positive definiteness numerically
+		double slope = dot(g.data(), direction.data(), n);
+		if (slope >= 0.0)
+		{
+			count = 0;
+			for (size_t i = 0; i < n; i++)
+			{
+				direction[i] = -g[i];
+			}
+			slope = -gradient_norm * gradient_norm;
+		}
+
+		// Without curvature information the first step moves the weights by at most unit length
+		double step = count == 0 ? std::min(1.0, 1.0 / gradient_norm) : 1.0;
+
+		// Strong Wolfe line search: bracket a step, then zoom in with cubic interpolation
+		double f_best = INFINITY;
+		unsigned int evaluations = 0;
+		auto evaluate_step = [&](double t, double &slope_t) -> double
+		{
+			for (size_t i = 0; i < n; i++)
+			{
+				x_trial[i] = x[i] + t * direction[i];
+			}
+			double value = objective.evaluate(x_trial, g_trial);
+			evaluations++;
+			report.evaluations++;
+			slope_t = dot(g_trial.data(), direction.data(), n);
+
+			if (value <= f + LBFGS_WOLFE_DECREASE * t * slope && value < f_best)
+			{
+				f_best = value;
+				std::swap(x_best, x_trial);
+				std::swap(g_best, g_trial);
+			}
+			return value;
+		};
+		auto wolfe = [&](double value, double t, double slope_t)
+		{
+			return value <= f + LBFGS_WOLFE_DECREASE * t * slope && std::abs(slope_t) <= -LBFGS_WOLFE_CURVATURE * slope;
+		};
+
+		bool accepted = false;
+		double low = 0.0, f_low = f, slope_low = slope;
+		double high = 0.0, f_high = f, slope_high = slope;
+		bool bracketed = false;
+
+		while (evaluations < options.max_evaluations)
+		{
+			double slope_t;
+			double value = evaluate_step(step, slope_t);
+
+			if (value > f + LBFGS_WOLFE_DECREASE * step * slope || (evaluations > 1 && value >= f_low))
+			{
+				high = step, f_high = value, slope_high = slope_t;
+				bracketed = true;
+				break;
+			}
+			if (wolfe(value, step, slope_t))
+			{
+				accepted = true;
+				break;
+			}
+			if (slope_t >= 0.0)
+			{
+				high = low, f_high = f_low, slope_high = slope_low;
+				low = step, f_low = value, slope_low = slope_t;
+				bracketed = true;
+				break;
+			}
+			low = step, f_low = value, slope_low = slope_t;
+			step *= 2;
+		}
+
+		while (bracketed && !accepted && evaluations < options.max_evaluations)
+		{
+			step = cubic_minimizer(low, f_low, slope_low, high, f_high, slope_high);
+
+			double slope_t;
+			double value = evaluate_step(step, slope_t);
+
+			if (value > f + LBFGS_WOLFE_DECREASE * step * slope || value >= f_low)
+			{
+				high = step, f_high = value, slope_high = slope_t;
+				continue;
+			}
+			if (wolfe(value, step, slope_t))
+			{
+				accepted = true;
+				break;
+			}
+			if (slope_t * (high - low) >= 0.0)
+			{
+				high = low, f_high = f_low, slope_high = slope_low;
+			}
+			low = step, f_low = value, slope_low = slope_t;
+		}
+
+		// Out of evaluations, settle for the best point with sufficient decrease
+		if (f_best == INFINITY)
+		{
+			if (count == 0)
+			{
+				break;
+			}
+
+			// Retry from steepest descent before giving up
+			count = 0;
+			continue;
+		}
+
+		// The accepted point is the best one, since later trials only enter the bracket if lower.
+		// Pairs without positive curvature would break the estimate, so they are not kept.
+		double curvature = 0.0;
+		double y_norm = 0.0;
+		for (size_t i = 0; i < n; i++)
+		{
+			double y = g_best[i] - g[i];
+			curvature += (x_best[i] - x[i]) * y;
+			y_norm += y * y;
+		}
+		if (curvature > 1e-10 * y_norm)
+		{
+			unsigned int slot = (start + count) % capacity;
+			if (count == capacity)
+			{
+				start = (start + 1) % capacity;
+			}
+			else
+			{
+				count++;
+			}
+
+			double *s = &s_history[(size_t)slot * n];
+			double *y = &y_history[(size_t)slot * n];
+			for (size_t i = 0; i < n; i++)
+			{
+				s[i] = x_best[i] - x[i];
+				y[i] = g_best[i] - g[i];
+			}
+			rho[slot] = 1.0 / curvature;
+		}
+
+		std::swap(x, x_best);
+		std::swap(g, g_best);
+		f = f_best;
+		report.iterations++;
+
+		if (options.verbose)
+		{
+			printf("Iteration %u - Loss: %.4e - Gradient: %.2e - Evaluations: %u\n", report.iterations, f, std::sqrt(dot(g.data(), g.data(), n)), report.evaluations);
+		}
+	}
+
+	set_parameters(network, x);
+
+	report.loss = f;
+	report.gradient_norm = std::sqrt(dot(g.data(), g.data(), n));
+	return report;
+}
@@ -0,0 +1,38 @@
+#ifndef LBFGS_H
+#define LBFGS_H
+
+#include "network.h"
+#include "dataset.h"
+
+// Settings of a full-batch L-BFGS run.
+struct LbfgsOptions
+{
+	unsigned int max_iterations = 100;  // Iterations before giving up.
+	unsigned int history = 10;          // Curvature pairs kept for the inverse Hessian estimate.
+	unsigned int max_evaluations = 20;  // Objective evaluations allowed per line search.
+	double target_loss = 0.0;           // Stop once the objective is at or below this value.
+	double gradient_tolerance = 1e-6;   // Stop once the gradient norm is below this, relative to the weight norm.
+	unsigned int num_threads = 0;       // Gradient threads, all hardware threads when 0.
+	bool verbose = false;               // Print the objective after each iteration.
+};
+
+// Outcome of an L-BFGS run.
+struct LbfgsReport
+{
+	unsigned int iterations;  // Iterations completed.
+	unsigned int evaluations; // Full-batch gradient evaluations, each one pass over the dataset.
+	double loss;              // Objective at the final weights.
+	double gradient_norm;     // Norm of the gradient at the final weights.
+	bool converged;           // Whether the target loss or the gradient tolerance was reached.
+};
+
+// Train the network with full-batch L-BFGS. Suited to small models, where a few dozen exact
+// full-dataset gradients replace many SGD epochs. The objective is the mean cross-entropy for
+// softmax outputs, and half the summed squared error otherwise, the losses backpropagation
+// differentiates. Gradients are computed on network copies in parallel over fixed shards of the
+// dataset and summed in shard order, so results do not depend on the thread count. Steps satisfy
+// the strong Wolfe conditions and the last history pairs are kept in contiguous buffers. Pruned
+// weights get no gradient and stay at zero.
+LbfgsReport train_lbfgs(Network &network, const Dataset &training, const LbfgsOptions &options = LbfgsOptions());
+
+#endif // LBFGS_H
@@ -1,11 +1,19 @@
 #include "network.h"
+#include "evaluation.h"
+#include "profiler.h"
+#include "allocation.h"
+#include "stream.h"
+#include "autotuner.h"
 
 #include <iostream>
 #include <stdexcept> // For runtime_error
 #include <chrono>    // For steady_clock
 #include <atomic>
+#include <future>    // For async
+#include <memory>    // For shared_ptr
+#include <thread>
 
-Network::Network(unsigned int input_size) : input_size(input_size)
+Network::Network(unsigned int input_size) : input_size(input_size), verbose(true), profiler(nullptr)
 {
 	// Constructor, if necessary
 }
@@ -24,11 +32,38 @@ Network* Network::addLayer(int num_neurons, Activation activation)
 	return this;
 }
 
-Network* Network::initialize()
+Network* Network::addLayer(const Conv2D &convolution, Activation activation)
 {
-	for (Layer &layer : this->layers)
+	Layer layer(convolution, activation);
+	unsigned int num_inputs = layers.size() == 0 ? this->input_size : layers.back().size();
+	if (layer.inputSize() != num_inputs)
+	{
+		throw std::runtime_error("Convolution input shape does not match the previous layer size.");
+	}
+	this->layers.push_back(layer);
+
+	return this;
+}
+
+Network* Network::addLayer(const MaxPool2D &pooling)
+{
+	Layer layer(pooling);
+	unsigned int num_inputs = layers.size() == 0 ? this->input_size : layers.back().size();
+	if (layer.inputSize() != num_inputs)
+	{
+		throw std::runtime_error("Pooling input shape does not match the previous layer size.");
+	}
+	this->layers.push_back(layer);
+
+	return this;
+}
+
+Network* Network::initialize(Initialization initialization, uint64_t seed)
+{
+	for (size_t l = 0; l < this->layers.size(); ++l)
 	{
-		layer.initialize();
+		// Every weight of a layer feeds one of its own neurons, so its size is the fan-out
+		this->layers[l].initialize(initialization, seed, l, this->layers[l].size());
 	}
 
 	return this;
@@ -85,38 +120,143 @@ unsigned int Network::size() const
 	return this->layers.size();
 }
 
-void Network::computeDeltas(const std::vector<double> &target)
+void Network::setVerbose(bool verbose)
+{
+	this->verbose = verbose;
+}
+
+void Network::setProfiler(Profiler *profiler)
 {
-	// Compute deltas for the output layer
-	this->layers.back().computeDeltas(target);
+	this->profiler = profiler;
+}
 
-	// Compute deltas for the hidden layers
-	for (int l = this->layers.size() - 2; l >= 0; --l)
+void Network::setAutotuner(Autotuner &autotuner)
+{
+	for (Layer &layer : this->layers)
 	{
-		this->layers[l].computeDeltas(this->layers[l + 1]);
+		if (layer.getType() == LayerType::Dense)
+		{
+			KernelChoice choice = autotuner.select(layer.size(), layer.inputSize(), 1);
+			layer.setKernel(choice.kernel, choice.num_threads);
+		}
 	}
 }
 
-std::vector<double> Network::forward(const std::vector<double> &inputs)
+unsigned int Network::inputSize() const
+{
+	return this->input_size;
+}
+
+const Layer &Network::getLayer(unsigned int index) const
+{
+	return this->layers.at(index);
+}
+
+Layer &Network::getLayer(unsigned int index)
+{
+	return this->layers.at(index);
+}
+
+double Network::prune(double threshold)
 {
-	std::vector<double> current_inputs = inputs;
 	for (Layer &layer : this->layers)
 	{
-		current_inputs = layer.forward(current_inputs);
+		layer.prune(threshold);
 	}
-	return current_inputs;
+	return this->sparsity();
 }
 
-void Network::backward(const std::vector<double> &input, double learning_rate)
+double Network::pruneToSparsity(double sparsity)
 {
-	std::vector<double> current_inputs = input;
 	for (Layer &layer : this->layers)
 	{
-		current_inputs = layer.backward(current_inputs, learning_rate);
+		layer.pruneToSparsity(sparsity);
 	}
+	return this->sparsity();
 }
 
-void Network::train(const std::vector<std::vector<double>> &input_data, const std::vector<std::vector<double>> &target_data, double learning_rate, int epochs)
+double Network::sparsity() const
+{
+	size_t pruned = 0;
+	size_t total = 0;
+	for (const Layer &layer : this->layers)
+	{
+		pruned += layer.prunedCount();
+		total += layer.getWeights().size();
+	}
+	return (double)pruned / total;
+}
+
+std::span<const double> Network::forward(std::span<const double> inputs)
+{
+	AllocationScope scope(AllocationCategory::Forward);
+	return this->forwardLayers(inputs);
+}
+
+std::span<const double> Network::forwardLayers(std::span<const double> inputs)
+{
+	// Each layer reads the previous layer's values in place
+	std::span<const double> current_inputs = inputs;
+	for (size_t l = 0; l < this->layers.size(); ++l)
+	{
+		if (this->profiler)
+		{
+			this->profiler->begin();
+		}
+		current_inputs = this->layers[l].forward(current_inputs);
+		if (this->profiler)
+		{
+			this->profiler->end(l, Phase::Forward);
+		}
+	}
+	return current_inputs;
+}
+
+double Network::backward(std::span<const double> input, const std::vector<double> &target, double learning_rate)
+{
+	double loss;
+	{
+		AllocationScope scope(AllocationCategory::Delta);
+
+		// Compute deltas and loss for the output layer
+		if (this->profiler)
+		{
+			this->profiler->begin();
+		}
+		loss = this->layers.back().computeDeltas(target);
+		if (this->profiler)
+		{
+			this->profiler->end(this->layers.size() - 1, Phase::Delta);
+		}
+	}
+
+	AllocationScope scope(AllocationCategory::Update);
+
+	// Each sweep over a layer's weights updates them and produces the deltas of the layer below
+	for (int l = this->layers.size() - 1; l >= 0; --l)
+	{
+		if (this->profiler)
+		{
+			this->profiler->begin();
+		}
+		if (l > 0)
+		{
+			this->layers[l].backward(this->layers[l - 1], learning_rate);
+		}
+		else
+		{
+			this->layers[l].backward(input, learning_rate);
+		}
+		if (this->profiler)
+		{
+			this->profiler->end(l, Phase::Update);
+		}
+	}
+
+	return loss;
+}
+
+void Network::checkData(const std::vector<std::vector<double>> &input_data, const std::vector<std::vector<double>> &target_data) const
 {
 	// Check if input and target data have the same size
 	if (input_data.size() != target_data.size())
@@ -135,94 +275,364 @@ void Network::train(const std::vector<std::vector<double>> &input_data, const st
 	{
 		throw std::runtime_error("Target data size does not match output layer size.");
 	}
+}
+
+double Network::trainEpoch(const std::vector<std::vector<double>> &input_data, const std::vector<std::vector<double>> &target_data, double learning_rate)
+{
+	double epoch_loss = 0.0; // Initialize epoch loss to 0
+
+	// Train the network on each instance
+	for (size_t i = 0; i < input_data.size(); ++i)
+	{
+		const std::vector<double> &input = input_data[i];
+		const std::vector<double> &target = target_data[i];
+
+		// Forward pass
+		this->forward(input);
+
+		// Backpropagate, updating weights and biases, and accumulate the loss
+		epoch_loss += this->backward(input, target, learning_rate);
+	}
+
+	// Divide by number of instances to get mean epoch loss
+	return epoch_loss / input_data.size();
+}
+
+void Network::printProgress(int epoch, int epochs, double epoch_loss, std::chrono::steady_clock::time_point begin)
+{
+	// Print epoch loss every 1% of epochs
+	if (epoch % (std::max(epochs, 100) / 100) == 0 || epoch == epochs - 1)
+	{
+		// Calculate time elapsed and predicted time to completion
+		std::chrono::steady_clock::time_point current_time = std::chrono::steady_clock::now();
+		double time_elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(current_time - begin).count() / 1000.0;
+		double time_per_epoch = time_elapsed / (epoch + 1);
+		double time_remaining = time_per_epoch * (epochs - epoch - 1);
+
+		// Make a progress bar and display current epoch loss and predicted time to completion
+		printf("\r[");
+		int pos = 50 * epoch / epochs;
+		for (int i = 0; i <= 50; ++i)
+		{
+			if (i < pos)
+			{
+				printf("=");
+			}
+			else if (i == pos)
+			{
+				printf(">");
+			}
+			else
+			{
+				printf(" ");
+			}
+		}
+		printf("] %d%% - Loss: %.2e - Elapsed: %.2fs - Remaining: %.2fs", epoch * 100 / epochs, epoch_loss, time_elapsed, time_remaining);
+
+		// Flush stdout
+		fflush(stdout);
+
+		// Print 100% and a full bar on the last epoch
+		if (epoch == epochs - 1)
+		{
+			printf("\r[");
+			for (int i = 0; i <= 50; ++i)
+			{
+				printf("=");
+			}
+			printf("] 100%% - Loss: %.4e - Elapsed: %.2fs - Total: %.2fs\n", epoch_loss, time_elapsed, time_elapsed + time_remaining);
+		}
+	}
+}
+
+void Network::train(const std::vector<std::vector<double>> &input_data, const std::vector<std::vector<double>> &target_data, double learning_rate, int epochs)
+{
+	this->checkData(input_data, target_data);
 
 	// Start timer
 	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
 
 	// Train the network for the specified number of epochs
-	printf("\nTraining network...\n\n");
+	if (this->verbose)
+	{
+		printf("\nTraining network...\n\n");
+	}
+
+	// Allocation statistics of each epoch, all zero unless tracking is compiled in
+	std::vector<AllocationStats> epoch_allocations;
 
 	for (int epoch = 0; epoch < epochs; ++epoch)
 	{
-		double epoch_loss = 0.0; // Initialize epoch loss to 0
+		AllocationCounter counter;
+		double epoch_loss = this->trainEpoch(input_data, target_data, learning_rate);
+		epoch_allocations.push_back(counter.stats());
 
-		// Train the network on each instance
-		for (size_t i = 0; i < input_data.size(); ++i)
+		if (this->verbose)
 		{
-			const std::vector<double> &input = input_data[i];
-			const std::vector<double> &target = target_data[i];
+			printProgress(epoch, epochs, epoch_loss, begin);
+		}
+	}
 
-			// Forward pass
-			std::vector<double> output = this->forward(input);
+	if (!this->verbose)
+	{
+		return;
+	}
 
-			// Compute deltas
-			this->computeDeltas(target);
+	printf("\nTraining complete for %d epochs with a learning rate of %.2f.\n\n", epochs, learning_rate);
 
-			// Backpropagate and update weights and biases
-			this->backward(input, learning_rate);
+	if (allocation_tracking_enabled())
+	{
+		for (size_t epoch = 0; epoch < epoch_allocations.size(); ++epoch)
+		{
+			std::string label = "Epoch " + std::to_string(epoch + 1);
+			print_allocation_stats(label.c_str(), epoch_allocations[epoch]);
+		}
+		printf("\n");
+	}
+
+	// Stop timer
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+	// Print training time
+	printf("Training time: %.3fs\n\n", std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count() / 1000.0);
+}
+
+void Network::train(SampleStream &stream, double learning_rate, int epochs)
+{
+	if (stream.inputSize() != this->input_size)
+	{
+		throw std::runtime_error("Input data size does not match input layer size.");
+	}
+	if (stream.outputSize() != this->layers.back().size())
+	{
+		throw std::runtime_error("Target data size does not match output layer size.");
+	}
+	if (stream.size() == 0)
+	{
+		throw std::runtime_error("Cannot train on an empty stream.");
+	}
+
+	// Start timer
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+
+	if (this->verbose)
+	{
+		printf("\nTraining network on %zu streamed samples...\n\n", stream.size());
+	}
+
+	// Buffers for the current sample, reused across the whole run
+	std::vector<double> input;
+	std::vector<double> target;
+
+	for (int epoch = 0; epoch < epochs; ++epoch)
+	{
+		stream.begin(epoch);
+
+		double epoch_loss = 0.0;
+		while (stream.next(input, target))
+		{
+			this->forward(input);
+			epoch_loss += this->backward(input, target, learning_rate);
+		}
+		epoch_loss /= stream.size();
 
-			// Compute loss
-			epoch_loss += this->layers.back().computeLoss(target);
+		if (this->verbose)
+		{
+			printProgress(epoch, epochs, epoch_loss, begin);
 		}
+	}
+
+	if (!this->verbose)
+	{
+		return;
+	}
+
+	printf("\nTraining complete for %d epochs with a learning rate of %.2f.\n\n", epochs, learning_rate);
+
+	// Stop timer
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
 
-		// Divide by number of instances to get mean epoch loss
-		epoch_loss /= input_data.size();
+	// Print training time
+	printf("Training time: %.3fs\n\n", std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count() / 1000.0);
+}
 
-		// Print epoch loss every 1% of epochs
-		if (epoch % (std::max(epochs, 100) / 100) == 0 || epoch == epochs - 1)
+int Network::train(const Dataset &training, const Dataset &validation, double learning_rate, int max_epochs, int patience, double min_delta)
+{
+	this->checkData(training.inputs, training.targets);
+	this->checkData(validation.inputs, validation.targets);
+	if (max_epochs < 1)
+	{
+		throw std::runtime_error("Early stopping needs at least one epoch.");
+	}
+
+	// Leave one core to the training thread while validation runs in the background
+	unsigned int validation_threads = std::max(2u, std::thread::hardware_concurrency()) - 1;
+
+	// Validation of the previous epoch, running against its own weight snapshot
+	std::shared_ptr<Network> pending_snapshot;
+	std::future<Evaluation> pending_evaluation;
+	int pending_epoch = -1;
+
+	std::shared_ptr<Network> best_snapshot;
+	double best_accuracy = -1.0;
+	int best_epoch = -1;
+	bool stop = false;
+
+	// Collect the pending validation result and update the best snapshot and patience
+	auto collect = [&]()
+	{
+		Evaluation evaluation = pending_evaluation.get();
+		if (evaluation.accuracy > best_accuracy + min_delta || best_snapshot == nullptr)
+		{
+			best_accuracy = evaluation.accuracy;
+			best_epoch = pending_epoch;
+			best_snapshot = pending_snapshot;
+		}
+		else if (pending_epoch - best_epoch >= patience)
 		{
-			// Calculate time elapsed and predicted time to completion
-			std::chrono::steady_clock::time_point current_time = std::chrono::steady_clock::now();
-			double time_elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(current_time - begin).count() / 1000.0;
-			double time_per_epoch = time_elapsed / (epoch + 1);
-			double time_remaining = time_per_epoch * (epochs - epoch - 1);
+			stop = true;
+		}
+		pending_snapshot.reset();
+	};
 
-			// Make a progress bar and display current epoch loss and predicted time to completion
-			printf("\r[");
-			int pos = 50 * epoch / epochs;
-			for (int i = 0; i <= 50; ++i)
-			{
-				if (i < pos)
-				{
-					printf("=");
-				}
-				else if (i == pos)
-				{
-					printf(">");
-				}
-				else
-				{
-					printf(" ");
-				}
-			}
-			printf("] %d%% - Loss: %.2e - Elapsed: %.2fs - Remaining: %.2fs", epoch * 100 / epochs, epoch_loss, time_elapsed, time_remaining);
+	// Start timer
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+
+	if (this->verbose)
+	{
+		printf("\nTraining network with early stopping (patience %d)...\n\n", patience);
+	}
 
-			// Flush stdout
-			fflush(stdout);
+	int epoch = 0;
+	for (; epoch < max_epochs && !stop; ++epoch)
+	{
+		double epoch_loss = this->trainEpoch(training.inputs, training.targets, learning_rate);
+		if (this->verbose)
+		{
+			printProgress(epoch, max_epochs, epoch_loss, begin);
+		}
 
-			// Print 100% and a full bar on the last epoch
-			if (epoch == epochs - 1)
-			{
-				printf("\r[");
-				for (int i = 0; i <= 50; ++i)
-				{
-					printf("=");
-				}
-				printf("] 100%% - Loss: %.4e - Elapsed: %.2fs - Total: %.2fs\n", epoch_loss, time_elapsed, time_elapsed + time_remaining);
-			}
+		// Epoch N - 1 was validated while epoch N trained
+		if (pending_evaluation.valid())
+		{
+			collect();
 		}
+
+		// Validate this epoch in the background while the next one trains
+		pending_snapshot = std::make_shared<Network>(*this);
+		pending_epoch = epoch;
+		pending_evaluation = std::async(std::launch::async, [snapshot = pending_snapshot, &validation, validation_threads]()
+										{ return evaluate(*snapshot, validation, 1, validation_threads); });
 	}
 
-	printf("\nTraining complete for %d epochs with a learning rate of %.2f.\n\n", epochs, learning_rate);
+	if (pending_evaluation.valid())
+	{
+		collect();
+	}
+
+	// Keep the best-scoring weights
+	if (best_snapshot)
+	{
+		*this = *best_snapshot;
+	}
+
+	if (!this->verbose)
+	{
+		return epoch;
+	}
+
+	if (stop)
+	{
+		printf("\nStopped early after %d epochs, validation accuracy plateaued.\n", epoch);
+	}
+	printf("\nBest validation accuracy %.2f%% at epoch %d with a learning rate of %.2f.\n\n", best_accuracy * 100, best_epoch + 1, learning_rate);
 
 	// Stop timer
 	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
 
 	// Print training time
 	printf("Training time: %.3fs\n\n", std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count() / 1000.0);
+
+	return epoch;
+}
+
+double Network::accumulateGradients(const std::vector<double> &input, const std::vector<double> &target, const std::function<void(unsigned int)> &layer_ready)
+{
+	this->forward(input);
+
+	double loss = this->layers.back().computeDeltas(target);
+
+	for (int l = this->layers.size() - 1; l >= 0; --l)
+	{
+		this->layers[l].accumulateGradients(l == 0 ? std::span<const double>(input) : this->layers[l - 1].getValues());
+
+		if (layer_ready)
+		{
+			layer_ready(l);
+		}
+
+		// Deltas of the layer below only read this layer's weights, which stay unchanged until applyGradients
+		if (l > 0)
+		{
+			this->layers[l - 1].computeDeltas(this->layers[l]);
+		}
+	}
+
+	return loss;
+}
+
+std::vector<double> &Network::getGradients(unsigned int layer)
+{
+	return this->layers.at(layer).getGradients();
+}
+
+void Network::applyGradients(double learning_rate)
+{
+	for (Layer &layer : this->layers)
+	{
+		layer.applyGradients(learning_rate);
+	}
+}
+
+std::vector<double> Network::predict(const std::vector<double> &input)
+{
+	AllocationScope scope(AllocationCategory::Predict);
+	std::span<const double> output = this->forwardLayers(input);
+	return std::vector<double>(output.begin(), output.end());
+}
+
+void Network::predict(std::span<const double> input, std::vector<double> &output) const
+{
+	AllocationScope scope(AllocationCategory::Predict);
+
+	// Ping-pong between the output and a per-thread buffer so the last layer writes into output
+	thread_local std::vector<double> buffer;
+
+	std::span<const double> current_inputs = input;
+	for (size_t l = 0; l < this->layers.size(); ++l)
+	{
+		std::vector<double> &outputs = (this->layers.size() - 1 - l) % 2 == 0 ? output : buffer;
+		this->layers[l].forward(current_inputs, outputs);
+		current_inputs = outputs;
+	}
+}
+
+void Network::predict(std::span<const double> inputs, std::vector<double> &outputs, unsigned int batch) const
+{
+	AllocationScope scope(AllocationCategory::Predict);
+
+	thread_local std::vector<double> buffer;
+
+	std::span<const double> current_inputs = inputs;
+	for (size_t l = 0; l < this->layers.size(); ++l)
+	{
+		std::vector<double> &layer_outputs = (this->layers.size() - 1 - l) % 2 == 0 ? outputs : buffer;
+		this->layers[l].forward(current_inputs, layer_outputs, batch);
+		current_inputs = layer_outputs;
+	}
 }
 
-std::vector<double> Network::predict(std::vector<double> &input)
+double Network::computeLoss(const std::vector<double> &output, const std::vector<double> &target) const
 {
-	return this->forward(input);
+	return this->layers.back().computeLoss(output, target);
 }
\ No newline at end of file
@@ -3,8 +3,16 @@
 
 #include "layer.h"
 #include "activation.h"
+#include "dataset.h"
 
 #include <vector>
+#include <span>
+#include <chrono>     // For steady_clock
+#include <functional> // For function
+
+class Autotuner;
+class Profiler;
+class SampleStream;
 
 class Network
 {
@@ -15,8 +23,15 @@ public:
 	// Add a layer to the network.
 	Network* addLayer(int num_neurons, Activation activation);
 
-	// Initialize the network and its layers.
-	Network* initialize();
+	// Add a convolution layer. The previous layer's outputs, or the network inputs, are read as
+	// channels x height x width values and must match the convolution's input shape.
+	Network* addLayer(const Conv2D &convolution, Activation activation);
+
+	// Add a max pooling layer, reading its inputs like a convolution layer.
+	Network* addLayer(const MaxPool2D &pooling);
+
+	// Initialize the network and its layers with counter-based random values for the seed.
+	Network* initialize(Initialization initialization = Initialization::Uniform, uint64_t seed = 0);
 
 	// Initialize the network and its layers with custom weights and biases.
 	Network* initialize(const std::vector<std::vector<double>> &bias, const std::vector<std::vector<std::vector<double>>> &weights);
@@ -30,24 +45,100 @@ public:
 	// Get the number of layers in the network.
 	unsigned int size() const;
 
+	// Get the number of inputs to the network.
+	unsigned int inputSize() const;
+
+	// Get a layer of the network. Its weights, biases and values can be viewed in place.
+	const Layer &getLayer(unsigned int index) const;
+	Layer &getLayer(unsigned int index);
+
+	// Prune weights with magnitude below the threshold. Pruned weights stay at zero during further
+	// training, so the network can be fine-tuned with train(). Returns the fraction of zero weights.
+	double prune(double threshold);
+
+	// Prune the smallest magnitude weights of each layer to reach the target sparsity.
+	// Returns the fraction of zero weights.
+	double pruneToSparsity(double sparsity);
+
+	// Get the fraction of weights that are pruned.
+	double sparsity() const;
+
+	// Enable or disable training progress output.
+	void setVerbose(bool verbose);
+
+	// Profile each layer's forward, delta and update phases during training, or nullptr to stop.
+	// The profiler must be created on the training thread.
+	void setProfiler(Profiler *profiler);
+
+	// Run every fully connected layer's weighted sums with the kernel and thread count the autotuner
+	// picked for its shape, tuning shapes it has not seen yet. Applies to training and predict, and
+	// to the layers present when called.
+	void setAutotuner(Autotuner &autotuner);
+
 	// Backpropagate and update weights and biases using gradient descent.
 	void train(const std::vector<std::vector<double>> &input_data, const std::vector<std::vector<double>> &target_data, double learning_rate, int epochs);
 
+	// Train with patience-based early stopping on a validation set. Each epoch is validated on a
+	// background thread against a weight snapshot while the next epoch trains. Training stops once
+	// validation accuracy has not improved by more than min_delta for patience epochs, and the
+	// best-scoring snapshot is kept. max_epochs must be at least 1. Returns the number of epochs trained.
+	int train(const Dataset &training, const Dataset &validation, double learning_rate, int max_epochs, int patience, double min_delta = 0.0);
+
+	// Train on samples streamed from disk, so only the stream's window is held in memory. Each epoch
+	// visits every sample once in the stream's shuffled order for that epoch.
+	void train(SampleStream &stream, double learning_rate, int epochs);
+
+	// Forward and backward pass for one sample that accumulates gradients instead of updating the
+	// weights. Layers are processed back to front and layer_ready(l) is called as soon as layer l's
+	// gradients are complete, so their reduction can overlap with the rest of the pass.
+	// Returns the sample's loss.
+	double accumulateGradients(const std::vector<double> &input, const std::vector<double> &target, const std::function<void(unsigned int)> &layer_ready = nullptr);
+
+	// Get the accumulated gradients of a layer.
+	std::vector<double> &getGradients(unsigned int layer);
+
+	// Apply the accumulated gradients of every layer and reset them to zero.
+	void applyGradients(double learning_rate);
+
+	// Print the training progress bar.
+	static void printProgress(int epoch, int epochs, double epoch_loss, std::chrono::steady_clock::time_point begin);
+
 	// Make predictions using the trained network.
-	std::vector<double> predict(std::vector<double> &input);
+	std::vector<double> predict(const std::vector<double> &input);
+
+	// Make predictions without modifying the network state, writing into the output buffer.
+	// Safe to call concurrently from multiple threads.
+	void predict(std::span<const double> input, std::vector<double> &output) const;
+
+	// Make predictions for a batch of row-major samples without modifying the network state, writing
+	// batch x output size values into the output buffer. Large layers run as blocked matrix products.
+	void predict(std::span<const double> inputs, std::vector<double> &outputs, unsigned int batch) const;
+
+	// Compute the output layer loss for a prediction.
+	double computeLoss(const std::vector<double> &output, const std::vector<double> &target) const;
 
 private:
 	unsigned int input_size;    // Number of inputs to the network.
 	std::vector<Layer> layers;  // Layers in the network.
+	bool verbose;               // Print training progress.
+	Profiler *profiler;         // Per-layer profiler, nullptr when not profiling.
+
+	// Check that the data matches the network's input and output sizes.
+	void checkData(const std::vector<std::vector<double>> &input_data, const std::vector<std::vector<double>> &target_data) const;
+
+	// Train the network for one epoch and return the mean loss.
+	double trainEpoch(const std::vector<std::vector<double>> &input_data, const std::vector<std::vector<double>> &target_data, double learning_rate);
 
-	// Compute deltas for the network.
-	void computeDeltas(const std::vector<double> &target);
+	// Forward pass through the network, attributing allocations to the forward category. Returns a
+	// view of the output layer's values.
+	std::span<const double> forward(std::span<const double> inputs);
 
-	// Forward pass through the network.
-	std::vector<double> forward(const std::vector<double> &inputs);
+	// Forward pass without an allocation scope, so allocations go to the caller's category.
+	std::span<const double> forwardLayers(std::span<const double> inputs);
 
-	// Update weights and biases using gradient descent.
-	void backward(const std::vector<double> &inputs, double learning_rate);
+	// Compute the output deltas, then walk the layers back to front, computing each layer's deltas
+	// while the layer above is updated. Returns the loss of the output layer.
+	double backward(std::span<const double> input, const std::vector<double> &target, double learning_rate);
 };
 
 #endif // NETWORK_H
\ No newline at end of file
@@ -0,0 +1,200 @@
+#include "online.h"
+
+#include <algorithm> // For copy
+#include <stdexcept> // For runtime_error
+
+// Weight of the newest sample in the moving average of the loss
+#define ONLINE_LOSS_DECAY 0.01
+
+OnlineTrainer::OnlineTrainer(Network &network, double learning_rate, unsigned int batch_size, unsigned int publish_interval, size_t capacity)
+	: network(network), learning_rate(learning_rate), batch_size(batch_size), publish_interval(publish_interval), capacity(capacity), input_size(network.inputSize()),
+	  output_size(network.getLayer(network.size() - 1).size()), head(0), count(0), flushing(false), stop(false), samples(0), loss(0.0)
+{
+	if (batch_size == 0 || publish_interval == 0 || capacity == 0)
+	{
+		throw std::runtime_error("Batch size, publish interval and capacity must be positive.");
+	}
+
+	this->inputs.resize(capacity * this->input_size);
+	this->targets.resize(capacity * this->output_size);
+
+	this->publish();
+	this->worker = std::thread(&OnlineTrainer::work, this);
+}
+
+OnlineTrainer::~OnlineTrainer()
+{
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->stop = true;
+	}
+	this->not_empty.notify_one();
+	this->worker.join();
+}
+
+void OnlineTrainer::push(std::span<const double> input, std::span<const double> target)
+{
+	if (input.size() != this->input_size || target.size() != this->output_size)
+	{
+		throw std::runtime_error("Sample size does not match network size.");
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(this->mutex);
+		this->not_full.wait(lock, [&]() { return this->count < this->capacity || this->failure; });
+		if (this->failure)
+		{
+			std::rethrow_exception(this->failure);
+		}
+
+		size_t slot = (this->head + this->count) % this->capacity;
+		std::copy(input.begin(), input.end(), this->inputs.begin() + slot * this->input_size);
+		std::copy(target.begin(), target.end(), this->targets.begin() + slot * this->output_size);
+		this->count++;
+	}
+	this->not_empty.notify_one();
+}
+
+void OnlineTrainer::push(const Dataset &batch)
+{
+	for (size_t i = 0; i < batch.size(); i++)
+	{
+		this->push(batch.inputs[i], batch.targets[i]);
+	}
+}
+
+void OnlineTrainer::flush()
+{
+	std::unique_lock<std::mutex> lock(this->mutex);
+	this->flushing = true;
+	this->not_empty.notify_one();
+	this->drained.wait(lock, [&]() { return !this->flushing || this->failure; });
+	if (this->failure)
+	{
+		std::rethrow_exception(this->failure);
+	}
+}
+
+void OnlineTrainer::predict(std::span<const double> input, std::vector<double> &output) const
+{
+	// Holding a reference keeps this snapshot alive even if a newer one is published meanwhile
+	std::shared_ptr<const Network> network = this->published.load();
+	network->predict(input, output);
+}
+
+std::shared_ptr<const Network> OnlineTrainer::snapshot() const
+{
+	return this->published.load();
+}
+
+size_t OnlineTrainer::trained() const
+{
+	return this->samples.load();
+}
+
+double OnlineTrainer::recentLoss() const
+{
+	return this->loss.load();
+}
+
+void OnlineTrainer::publish()
+{
+	// The copy is made before the swap, so readers only ever wait for the pointer exchange
+	this->published.store(std::make_shared<const Network>(this->network));
+}
+
+void OnlineTrainer::work()
+{
+	try
+	{
+		this->train();
+	}
+	catch (...)
+	{
+		// Stop training and wake every waiter, which rethrows the error
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->failure = std::current_exception();
+		}
+		this->not_full.notify_all();
+		this->drained.notify_all();
+	}
+}
+
+void OnlineTrainer::train()
+{
+	// Training copies of the current sample, reused so steady-state training does not allocate
+	std::vector<double> input(this->input_size);
+	std::vector<double> target(this->output_size);
+
+	unsigned int in_batch = 0;
+	size_t since_publish = 0;
+
+	while (true)
+	{
+		bool idle;
+		bool flushed;
+		bool stopping;
+		{
+			std::unique_lock<std::mutex> lock(this->mutex);
+			this->not_empty.wait(lock, [&]() { return this->count > 0 || this->flushing || this->stop; });
+
+			idle = this->count == 0;
+			flushed = this->flushing;
+			stopping = this->stop;
+			if (!idle)
+			{
+				std::copy_n(this->inputs.begin() + this->head * this->input_size, this->input_size, input.begin());
+				std::copy_n(this->targets.begin() + this->head * this->output_size, this->output_size, target.begin());
+				this->head = (this->head + 1) % this->capacity;
+				this->count--;
+			}
+		}
+
+		if (idle)
+		{
+			// Apply a partial mini-batch as the mean of the samples it has. The copy for publishing
+			// is made without the lock, so pushes are not held up by it.
+			if (in_batch > 0)
+			{
+				this->network.applyGradients(this->learning_rate / in_batch);
+				in_batch = 0;
+			}
+			this->publish();
+			since_publish = 0;
+
+			if (flushed)
+			{
+				// Samples pushed meanwhile are trained before the flush completes
+				{
+					std::lock_guard<std::mutex> lock(this->mutex);
+					this->flushing = this->count > 0;
+				}
+				this->drained.notify_all();
+			}
+			if (stopping)
+			{
+				return;
+			}
+			continue;
+		}
+		this->not_full.notify_one();
+
+		double sample_loss = this->network.accumulateGradients(input, target);
+		if (++in_batch == this->batch_size)
+		{
+			this->network.applyGradients(this->learning_rate / this->batch_size);
+			in_batch = 0;
+		}
+
+		size_t trained = this->samples.fetch_add(1) + 1;
+		double average = this->loss.load(std::memory_order_relaxed);
+		this->loss.store(trained == 1 ? sample_loss : average + ONLINE_LOSS_DECAY * (sample_loss - average), std::memory_order_relaxed);
+
+		if (++since_publish >= this->publish_interval)
+		{
+			this->publish();
+			since_publish = 0;
+		}
+	}
+}
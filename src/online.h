@@ -0,0 +1,97 @@
+#ifndef ONLINE_H
+#define ONLINE_H
+
+#include "network.h"
+#include "dataset.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <exception> // For exception_ptr
+#include <memory> // For shared_ptr
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+// Online trainer for an unbounded stream of labelled samples. Pushed samples wait in a fixed-size
+// queue and are trained in mini-batches on a background thread, so memory stays bounded however
+// long the stream runs. Every publish_interval samples a copy of the weights is published, and
+// predict() reads the latest copy without ever waiting for training (an RCU-style swap: old copies
+// are freed once their last reader drops them). If training throws, the background thread stops and
+// the error is rethrown by the next push() or flush().
+class OnlineTrainer
+{
+public:
+	// Train the network in place. The network must not be used directly while the trainer exists,
+	// read it through snapshot() instead. capacity is the number of samples the queue holds.
+	OnlineTrainer(Network &network, double learning_rate, unsigned int batch_size = 1, unsigned int publish_interval = 1000, size_t capacity = 4096);
+
+	// Train the queued samples and publish the final weights. A training error is discarded here,
+	// call flush() first to see it.
+	~OnlineTrainer();
+
+	OnlineTrainer(const OnlineTrainer &) = delete;
+	OnlineTrainer &operator=(const OnlineTrainer &) = delete;
+
+	// Queue a labelled sample, blocking while the queue is full. Rethrows a training error.
+	void push(std::span<const double> input, std::span<const double> target);
+
+	// Queue every sample of a mini-batch.
+	void push(const Dataset &batch);
+
+	// Wait until every queued sample is trained, apply any partial mini-batch and publish the weights.
+	// Rethrows a training error.
+	void flush();
+
+	// Make a prediction with the latest published weights. Safe to call concurrently with training
+	// and with other predictions.
+	void predict(std::span<const double> input, std::vector<double> &output) const;
+
+	// Get the latest published weights.
+	std::shared_ptr<const Network> snapshot() const;
+
+	// Get the number of samples trained so far.
+	size_t trained() const;
+
+	// Get the exponential moving average of the training loss.
+	double recentLoss() const;
+
+private:
+	Network &network;              // Network trained by the background thread.
+	double learning_rate;          // Learning rate of each mini-batch step.
+	unsigned int batch_size;       // Samples per gradient step.
+	unsigned int publish_interval; // Samples trained between published snapshots.
+	size_t capacity;               // Samples the queue holds.
+	unsigned int input_size;       // Values per queued input.
+	unsigned int output_size;      // Values per queued target.
+
+	std::vector<double> inputs;    // Ring buffer of capacity inputs.
+	std::vector<double> targets;   // Ring buffer of capacity targets.
+	size_t head;                   // Slot of the oldest queued sample.
+	size_t count;                  // Number of queued samples.
+	bool flushing;                 // A flush is waiting for the queue to drain.
+	bool stop;                     // Set to shut the background thread down.
+	std::exception_ptr failure;    // Error that stopped the background thread, if any.
+
+	std::mutex mutex;                      // Guards the queue and its flags.
+	std::condition_variable not_empty;     // Signalled when a sample is queued or on shutdown.
+	std::condition_variable not_full;      // Signalled when a slot is freed.
+	std::condition_variable drained;       // Signalled when the queue is empty and idle.
+
+	std::atomic<std::shared_ptr<const Network>> published; // Latest published weights.
+	std::atomic<size_t> samples;                           // Samples trained so far.
+	std::atomic<double> loss;                              // Moving average of the loss.
+
+	std::thread worker; // Background training thread.
+
+	// Background thread, runs train() and keeps the error that stops it.
+	void work();
+
+	// Loop training queued samples until stopped.
+	void train();
+
+	// Publish a copy of the current weights.
+	void publish();
+};
+
+#endif // ONLINE_H
@@ -0,0 +1,199 @@
+#include "profiler.h"
+#include "network.h"
+
+#include <cstdio>
+#include <cstring> // For memset
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static const char *phase_names[PHASE_COUNT] = {"forward", "delta", "update"};
+
+// Open one counter for the calling thread, user space only so restrictive perf settings still allow it.
+static int open_counter(uint64_t config, int group_fd)
+{
+	perf_event_attr attr;
+	std::memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = config;
+	attr.disabled = group_fd == -1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_GROUP;
+
+	return syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+Profiler::Profiler() : available(false)
+{
+	uint64_t configs[4] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+
+	this->fds[0] = open_counter(configs[0], -1);
+	this->available = this->fds[0] >= 0;
+	for (int i = 1; i < 4; i++)
+	{
+		this->fds[i] = this->available ? open_counter(configs[i], this->fds[0]) : -1;
+		this->available = this->available && this->fds[i] >= 0;
+	}
+
+	// Without counters only wall time is recorded, callers check countersAvailable() and the report notes it
+	if (this->available)
+	{
+		ioctl(this->fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+		ioctl(this->fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	}
+
+	std::memset(this->start, 0, sizeof(this->start));
+}
+
+Profiler::~Profiler()
+{
+	for (int i = 3; i >= 0; i--)
+	{
+		if (this->fds[i] >= 0)
+		{
+			close(this->fds[i]);
+		}
+	}
+}
+
+bool Profiler::countersAvailable() const
+{
+	return this->available;
+}
+
+void Profiler::read(uint64_t values[4]) const
+{
+	// PERF_FORMAT_GROUP layout: number of counters followed by each value
+	uint64_t buffer[5] = {0, 0, 0, 0, 0};
+	if (!this->available || ::read(this->fds[0], buffer, sizeof(buffer)) != sizeof(buffer))
+	{
+		std::memset(values, 0, 4 * sizeof(uint64_t));
+		return;
+	}
+	std::memcpy(values, buffer + 1, 4 * sizeof(uint64_t));
+}
+
+void Profiler::begin()
+{
+	this->read(this->start);
+	this->start_time = std::chrono::steady_clock::now();
+}
+
+void Profiler::end(unsigned int layer, Phase phase)
+{
+	std::chrono::steady_clock::time_point end_time = std::chrono::steady_clock::now();
+	uint64_t values[4];
+	this->read(values);
+
+	size_t index = (size_t)layer * PHASE_COUNT + (size_t)phase;
+	if (index >= this->counters.size())
+	{
+		this->counters.resize((size_t)(layer + 1) * PHASE_COUNT, PhaseCounters());
+	}
+
+	PhaseCounters &counters = this->counters[index];
+	counters.calls++;
+	counters.seconds += std::chrono::duration<double>(end_time - this->start_time).count();
+	counters.cycles += values[0] - this->start[0];
+	counters.instructions += values[1] - this->start[1];
+	counters.cache_misses += values[2] - this->start[2];
+	counters.branch_misses += values[3] - this->start[3];
+}
+
+const PhaseCounters &Profiler::getCounters(unsigned int layer, Phase phase) const
+{
+	return this->counters.at((size_t)layer * PHASE_COUNT + (size_t)phase);
+}
+
+void Profiler::reset()
+{
+	this->counters.clear();
+}
+
+void Profiler::report(const Network &network) const
+{
+	printf("\n%-6s %-8s %10s %10s %8s %6s %12s %12s %10s %10s\n", "Layer", "Phase", "Calls", "Time (s)", "GFLOP/s", "IPC", "Cache miss", "Branch miss", "Bytes/FLOP", "Shape");
+
+	for (unsigned int l = 0; l < network.size() && (size_t)l * PHASE_COUNT < this->counters.size(); l++)
+	{
+		const Layer &layer = network.getLayer(l);
+		LayerType type = layer.getType();
+		double outputs = layer.size();
+		double inputs = layer.inputSize();
+
+		// Weights are used once per output position: every output of a dense layer, every output
+		// pixel of a convolution, whose filters are shared across positions
+		double weights = layer.getWeights().size();
+		double biases = layer.getBiases().size();
+		double positions = type == LayerType::Conv2D ? outputs / layer.weightRows() : 1;
+		double rows = type == LayerType::Conv2D ? layer.weightRows() : outputs;
+		double cols = type == LayerType::Conv2D ? weights / layer.weightRows() : inputs;
+
+		for (int p = 0; p < PHASE_COUNT; p++)
+		{
+			const PhaseCounters &counters = this->counters[(size_t)l * PHASE_COUNT + p];
+			if (counters.calls == 0)
+			{
+				continue;
+			}
+
+			// Per-sample work and traffic of each phase, the weights dominate both. Pooling does
+			// comparisons on its inputs and has no weights.
+			double flops = 0.0;
+			double bytes = 0.0;
+			switch ((Phase)p)
+			{
+			case Phase::Forward:
+				if (type == LayerType::MaxPool2D)
+				{
+					const MaxPool2D &pooling = layer.getPooling();
+					flops = outputs * (pooling.size * pooling.size - 1);
+					bytes = (inputs + outputs) * sizeof(double);
+				}
+				else
+				{
+					flops = 2 * positions * weights + outputs;
+					bytes = (weights + biases + inputs) * sizeof(double);
+				}
+				break;
+			case Phase::Delta:
+				// Only the output layer's loss and deltas, elementwise over its outputs and targets.
+				// Hidden layer deltas come out of the fused sweep counted under Update.
+				flops = 3 * outputs;
+				bytes = 3 * outputs * sizeof(double);
+				break;
+			case Phase::Update:
+				if (type == LayerType::MaxPool2D)
+				{
+					// Deltas are routed back through the switches
+					flops = 0.0;
+					bytes = l > 0 ? (outputs + inputs) * sizeof(double) : 0.0;
+				}
+				else
+				{
+					// Above the first layer the same sweep also computes the previous layer's deltas
+					flops = 2 * positions * weights + weights + 2 * biases + (l > 0 ? 2 * positions * weights + inputs : 0);
+					bytes = 2 * (weights + biases) * sizeof(double);
+				}
+				break;
+			}
+
+			double gflops = flops > 0 ? flops * counters.calls / counters.seconds / 1e9 : 0.0;
+			double bytes_per_flop = flops > 0 ? bytes / flops : 0.0;
+			double ipc = counters.cycles ? (double)counters.instructions / counters.cycles : 0.0;
+
+			printf("%-6u %-8s %10lu %10.3f %8.2f %6.2f %12lu %12lu %10.2f %5.0fx%-5.0f\n", l, phase_names[p], (unsigned long)counters.calls, counters.seconds, gflops, ipc,
+				   (unsigned long)counters.cache_misses, (unsigned long)counters.branch_misses, bytes_per_flop, rows, cols);
+		}
+	}
+
+	if (!this->available)
+	{
+		printf("\nHardware counters unavailable, IPC and miss counts are zero.\n");
+	}
+	printf("\n");
+}
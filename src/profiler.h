@@ -0,0 +1,74 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <chrono> // For steady_clock
+#include <stdint.h> // For uint64_t
+#include <vector>
+
+class Network;
+
+// Training phases measured per layer.
+enum class Phase
+{
+	Forward, // Weighted sums and activations.
+	Delta,   // Output layer delta computation.
+	Update,  // Weight and bias update, fused with the previous layer's deltas.
+};
+
+#define PHASE_COUNT 3
+
+// Hardware counter totals for one layer and phase.
+struct PhaseCounters
+{
+	uint64_t calls;         // Number of measured calls.
+	double seconds;         // Wall time.
+	uint64_t cycles;        // CPU cycles.
+	uint64_t instructions;  // Retired instructions.
+	uint64_t cache_misses;  // Last level cache misses.
+	uint64_t branch_misses; // Mispredicted branches.
+};
+
+// Per-layer, per-phase profiler backed by Linux perf_event_open hardware counters. Counters are
+// opened for the thread that constructs the profiler, so it must also be the thread that trains.
+// When counters are unavailable (e.g. in a container) only wall time is recorded, silently: check
+// countersAvailable() or read the note at the end of report().
+class Profiler
+{
+public:
+	Profiler();
+	~Profiler();
+
+	Profiler(const Profiler &) = delete;
+	Profiler &operator=(const Profiler &) = delete;
+
+	// Check whether hardware counters are being recorded.
+	bool countersAvailable() const;
+
+	// Start measuring a phase.
+	void begin();
+
+	// Stop measuring and add the counts to the layer and phase.
+	void end(unsigned int layer, Phase phase);
+
+	// Get the totals of a layer and phase.
+	const PhaseCounters &getCounters(unsigned int layer, Phase phase) const;
+
+	// Clear all totals.
+	void reset();
+
+	// Print a per-layer report with achieved FLOP/s and bytes per FLOP for roofline analysis.
+	// Convolution work counts each filter once per output position, pooling counts comparisons.
+	void report(const Network &network) const;
+
+private:
+	int fds[4];                                      // Counter file descriptors, fds[0] leads the group.
+	bool available;                                  // Whether the counters opened.
+	uint64_t start[4];                               // Counter values at begin().
+	std::chrono::steady_clock::time_point start_time; // Time at begin().
+	std::vector<PhaseCounters> counters;             // Totals indexed by layer * PHASE_COUNT + phase.
+
+	// Read the current counter values.
+	void read(uint64_t values[4]) const;
+};
+
+#endif // PROFILER_H
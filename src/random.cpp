@@ -0,0 +1,85 @@
+#include "random.h"
+
+#include <cmath>
+#include <utility> // For swap
+
+// Stream identifiers keep the counters of different consumers apart
+#define STREAM_WEIGHTS 0x5745494748540000ULL
+#define STREAM_SHUFFLE 0x53485546464c4500ULL
+
+uint64_t splitmix64(uint64_t x)
+{
+	x += 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+uint64_t random_bits(uint64_t seed, uint64_t a, uint64_t b, uint64_t c)
+{
+	// Chain the counters through the mixer so each one affects every output bit
+	uint64_t x = splitmix64(seed);
+	x = splitmix64(x ^ a);
+	x = splitmix64(x ^ b);
+	return splitmix64(x ^ c);
+}
+
+double random_uniform(uint64_t seed, uint64_t a, uint64_t b, uint64_t c)
+{
+	// Top 53 bits fill the double mantissa exactly
+	return (random_bits(seed, a, b, c) >> 11) * 0x1.0p-53;
+}
+
+double random_normal(uint64_t seed, uint64_t a, uint64_t b, uint64_t c)
+{
+	// Box-Muller from two independent draws of the same key
+	uint64_t bits = random_bits(seed, a, b, c);
+	double u1 = ((splitmix64(bits) >> 11) + 1) * 0x1.0p-53; // (0, 1] so the log is finite
+	double u2 = (bits >> 11) * 0x1.0p-53;
+	return std::sqrt(-2.0 * std::log(u1)) * std::cos(2.0 * M_PI * u2);
+}
+
+double initial_weight(Initialization initialization, uint64_t seed, unsigned int layer, unsigned int row, unsigned int column, unsigned int fan_in, unsigned int fan_out)
+{
+	uint64_t stream = STREAM_WEIGHTS | layer;
+	bool bias = column == fan_in;
+
+	switch (initialization)
+	{
+	case Initialization::Xavier:
+	{
+		if (bias)
+		{
+			return 0.0;
+		}
+		double limit = std::sqrt(6.0 / (fan_in + fan_out));
+		return limit * (2 * random_uniform(seed, stream, row, column) - 1);
+	}
+	case Initialization::He:
+		if (bias)
+		{
+			return 0.0;
+		}
+		return std::sqrt(2.0 / fan_in) * random_normal(seed, stream, row, column);
+	case Initialization::Uniform:
+	default:
+		return 2 * random_uniform(seed, stream, row, column) - 1;
+	}
+}
+
+std::vector<size_t> random_permutation(uint64_t seed, uint64_t epoch, size_t size)
+{
+	std::vector<size_t> permutation(size);
+	for (size_t i = 0; i < size; i++)
+	{
+		permutation[i] = i;
+	}
+
+	// Fisher-Yates, each swap keyed by its position
+	for (size_t i = size; i > 1; i--)
+	{
+		size_t j = random_bits(seed, STREAM_SHUFFLE, epoch, i) % i;
+		std::swap(permutation[i - 1], permutation[j]);
+	}
+	return permutation;
+}
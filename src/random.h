@@ -0,0 +1,37 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <stdint.h> // For uint64_t
+#include <cstddef>  // For size_t
+#include <vector>
+
+// Counter-based random numbers. Every value is a pure function of its seed and counters, so
+// results are identical regardless of call order or how work is split across threads.
+
+// Weight initialization schemes.
+enum class Initialization
+{
+	Uniform, // Weights and biases uniform in [-1, 1).
+	Xavier,  // Weights uniform in +-sqrt(6 / (fan_in + fan_out)), zero biases. Suits sigmoid and tanh.
+	He,      // Weights normal with standard deviation sqrt(2 / fan_in), zero biases. Suits relu.
+};
+
+// Mix a 64-bit value with the splitmix64 finalizer.
+uint64_t splitmix64(uint64_t x);
+
+// Hash a seed and up to three counters into 64 random bits.
+uint64_t random_bits(uint64_t seed, uint64_t a, uint64_t b = 0, uint64_t c = 0);
+
+// Uniform value in [0, 1) for the given seed and counters.
+double random_uniform(uint64_t seed, uint64_t a, uint64_t b = 0, uint64_t c = 0);
+
+// Standard normal value for the given seed and counters.
+double random_normal(uint64_t seed, uint64_t a, uint64_t b = 0, uint64_t c = 0);
+
+// Initial value of a weight at (layer, row, column). Column fan_in is the neuron's bias.
+double initial_weight(Initialization initialization, uint64_t seed, unsigned int layer, unsigned int row, unsigned int column, unsigned int fan_in, unsigned int fan_out);
+
+// Reproducible permutation of [0, size) for the given seed and epoch.
+std::vector<size_t> random_permutation(uint64_t seed, uint64_t epoch, size_t size);
+
+#endif // RANDOM_H
@@ -0,0 +1,344 @@
+#include "shared_model.h"
+
+#include <atomic>
+#include <cstring>   // For memcpy
+#include <stdexcept> // For runtime_error
+
+#include <fcntl.h>    // For O_* constants
+#include <sys/mman.h> // For shm_open, mmap
+#include <unistd.h>   // For ftruncate, close
+
+#define SHARED_MODEL_MAGIC 0x4c444f4d4e4e0001ULL
+#define SHARED_CONTROL_MAGIC 0x4c5254434e4e0001ULL
+
+// Layout of the control segment.
+struct SharedControl
+{
+	uint64_t magic;
+	std::atomic<uint64_t> next_version; // Last reserved version.
+	std::atomic<uint64_t> version;      // Current published version, 0 if none.
+};
+
+// Layout of the start of a model segment, followed by one SharedLayerHeader per layer and then
+// the biases and row-major weights of each layer.
+struct SharedModelHeader
+{
+	uint64_t magic;
+	uint64_t version;
+	uint32_t input_size;
+	uint32_t num_layers;
+};
+
+struct SharedLayerHeader
+{
+	uint32_t num_neurons;
+	uint32_t num_inputs;
+	uint32_t activation;
+	uint32_t padding;
+};
+
+static std::string segment_name(const std::string &name, uint64_t version)
+{
+	return "/" + name + ".v" + std::to_string(version);
+}
+
+// Map a shared memory segment, creating and sizing it if create is set.
+static void *map_segment(const std::string &segment, size_t &size, bool create, bool writable)
+{
+	int fd = shm_open(segment.c_str(), create ? O_RDWR | O_CREAT : (writable ? O_RDWR : O_RDONLY), 0644);
+	if (fd < 0)
+	{
+		throw std::runtime_error("Unable to open shared memory segment `" + segment + "`!");
+	}
+
+	if (create)
+	{
+		if (ftruncate(fd, size) != 0)
+		{
+			close(fd);
+			throw std::runtime_error("Unable to size shared memory segment `" + segment + "`!");
+		}
+	}
+	else
+	{
+		off_t end = lseek(fd, 0, SEEK_END);
+		if (end <= 0)
+		{
+			close(fd);
+			throw std::runtime_error("Shared memory segment `" + segment + "` is empty!");
+		}
+		size = end;
+	}
+
+	void *mapping = mmap(nullptr, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (mapping == MAP_FAILED)
+	{
+		throw std::runtime_error("Unable to map shared memory segment `" + segment + "`!");
+	}
+	return mapping;
+}
+
+// Map the control segment, creating it if it does not exist yet.
+static SharedControl *map_control(const std::string &name, bool create)
+{
+	size_t size = sizeof(SharedControl);
+	SharedControl *control = (SharedControl *)map_segment("/" + name, size, create, true);
+
+	// A freshly created segment is zero-filled, claim it
+	uint64_t expected = 0;
+	std::atomic_ref<uint64_t>(control->magic).compare_exchange_strong(expected, SHARED_CONTROL_MAGIC);
+
+	if (control->magic != SHARED_CONTROL_MAGIC)
+	{
+		munmap(control, sizeof(SharedControl));
+		throw std::runtime_error("Invalid shared model control segment `" + name + "`!");
+	}
+	return control;
+}
+
+uint64_t publish_model(const Network &network, const std::string &name)
+{
+	// Compute the segment size, rejecting unsupported layers before anything is mapped
+	size_t size = sizeof(SharedModelHeader) + network.size() * sizeof(SharedLayerHeader);
+	for (unsigned int l = 0; l < network.size(); l++)
+	{
+		const Layer &layer = network.getLayer(l);
+		if (layer.getType() != LayerType::Dense)
+		{
+			throw std::runtime_error("Shared models only support fully connected layers.");
+		}
+		size += (size_t)layer.size() * (layer.inputSize() + 1) * sizeof(double);
+	}
+
+	SharedControl *control = map_control(name, true);
+	uint64_t version = control->next_version.fetch_add(1) + 1;
+
+	std::string segment = segment_name(name, version);
+	char *mapping;
+	try
+	{
+		mapping = (char *)map_segment(segment, size, true, true);
+	}
+	catch (const std::runtime_error &)
+	{
+		munmap(control, sizeof(SharedControl));
+		shm_unlink(segment.c_str());
+		throw;
+	}
+
+	SharedModelHeader *header = (SharedModelHeader *)mapping;
+	header->magic = SHARED_MODEL_MAGIC;
+	header->version = version;
+	header->input_size = network.inputSize();
+	header->num_layers = network.size();
+
+	SharedLayerHeader *layer_headers = (SharedLayerHeader *)(mapping + sizeof(SharedModelHeader));
+	double *data = (double *)(layer_headers + network.size());
+
+	for (unsigned int l = 0; l < network.size(); l++)
+	{
+		const Layer &layer = network.getLayer(l);
+		std::span<const double> weights = layer.getWeights();
+		std::span<const double> biases = layer.getBiases();
+
+		layer_headers[l] = {layer.size(), layer.inputSize(), ActivationFunctions::id(layer.getActivation()), 0};
+
+		std::memcpy(data, biases.data(), biases.size_bytes());
+		data += biases.size();
+		std::memcpy(data, weights.data(), weights.size_bytes());
+		data += weights.size();
+	}
+
+	munmap(mapping, size);
+
+	// Only move the current version forward, a concurrent publisher may have installed a later one
+	uint64_t current = control->version.load(std::memory_order_acquire);
+	while (current < version && !control->version.compare_exchange_weak(current, version, std::memory_order_acq_rel, std::memory_order_acquire))
+	{
+	}
+	munmap(control, sizeof(SharedControl));
+
+	// Drop the name of whichever of the two versions is no longer current
+	uint64_t stale = current < version ? current : version;
+	if (stale != 0)
+	{
+		shm_unlink(segment_name(name, stale).c_str());
+	}
+	return version;
+}
+
+void unlink_model(const std::string &name)
+{
+	SharedControl *control = map_control(name, false);
+	uint64_t version = control->version.load();
+	munmap(control, sizeof(SharedControl));
+
+	if (version != 0)
+	{
+		shm_unlink(segment_name(name, version).c_str());
+	}
+	shm_unlink(("/" + name).c_str());
+}
+
+SharedModel::SharedModel(const std::string &name, uint64_t version) : mapping_size(0), version(version)
+{
+	this->mapping = map_segment(segment_name(name, version), this->mapping_size, false, false);
+
+	// Every header and layer is checked against the mapping size before it is read, so a truncated
+	// or foreign segment is rejected rather than read out of bounds
+	try
+	{
+		const char *bytes = (const char *)this->mapping;
+		const SharedModelHeader *header = (const SharedModelHeader *)bytes;
+		if (this->mapping_size < sizeof(SharedModelHeader) || header->magic != SHARED_MODEL_MAGIC || header->version != version)
+		{
+			throw std::runtime_error("Invalid shared model segment `" + name + "`!");
+		}
+
+		size_t remaining = this->mapping_size - sizeof(SharedModelHeader);
+		if (header->num_layers == 0 || remaining / sizeof(SharedLayerHeader) < header->num_layers)
+		{
+			throw std::runtime_error("Truncated shared model segment `" + name + "`!");
+		}
+		remaining -= (size_t)header->num_layers * sizeof(SharedLayerHeader);
+
+		this->input_size = header->input_size;
+
+		const SharedLayerHeader *layer_headers = (const SharedLayerHeader *)(bytes + sizeof(SharedModelHeader));
+		const double *data = (const double *)(layer_headers + header->num_layers);
+
+		this->layers.reserve(header->num_layers);
+		unsigned int previous_size = this->input_size;
+		for (uint32_t l = 0; l < header->num_layers; l++)
+		{
+			LayerView layer;
+			layer.num_neurons = layer_headers[l].num_neurons;
+			layer.num_inputs = layer_headers[l].num_inputs;
+			if (layer.num_neurons == 0 || layer.num_inputs != previous_size)
+			{
+				throw std::runtime_error("Invalid shared model segment `" + name + "`!");
+			}
+
+			size_t values = (size_t)layer.num_neurons * (layer.num_inputs + 1ULL);
+			if (remaining / sizeof(double) < values)
+			{
+				throw std::runtime_error("Truncated shared model segment `" + name + "`!");
+			}
+			remaining -= values * sizeof(double);
+
+			layer.activation = ActivationFunctions::fromId(layer_headers[l].activation);
+			layer.biases = data;
+			layer.weights = data + layer.num_neurons;
+			data += values;
+			previous_size = layer.num_neurons;
+			this->layers.emplace_back(layer);
+		}
+	}
+	catch (...)
+	{
+		munmap(this->mapping, this->mapping_size);
+		throw;
+	}
+}
+
+SharedModel::~SharedModel()
+{
+	munmap(this->mapping, this->mapping_size);
+}
+
+void SharedModel::predict(const std::vector<double> &input, std::vector<double> &output) const
+{
+	if (input.size() != this->input_size)
+	{
+		throw std::runtime_error("Input size does not match network input size.");
+	}
+
+	thread_local std::vector<double> buffer;
+
+	const std::vector<double> *current_inputs = &input;
+	for (size_t l = 0; l < this->layers.size(); l++)
+	{
+		const LayerView &layer = this->layers[l];
+		std::vector<double> &outputs = (this->layers.size() - 1 - l) % 2 == 0 ? output : buffer;
+		outputs.resize(layer.num_neurons);
+
+		const double *x = current_inputs->data();
+		for (unsigned int i = 0; i < layer.num_neurons; i++)
+		{
+			const double *row = layer.weights + (size_t)i * layer.num_inputs;
+			double sum = layer.biases[i];
+			for (unsigned int j = 0; j < layer.num_inputs; j++)
+			{
+				sum += x[j] * row[j];
+			}
+			outputs[i] = layer.activation.function(sum);
+		}
+
+		if (layer.activation.normalize)
+		{
+			layer.activation.normalize(outputs.data(), outputs.size());
+		}
+		current_inputs = &outputs;
+	}
+}
+
+uint64_t SharedModel::getVersion() const
+{
+	return this->version;
+}
+
+unsigned int SharedModel::inputSize() const
+{
+	return this->input_size;
+}
+
+unsigned int SharedModel::size() const
+{
+	return this->layers.size();
+}
+
+ModelPool::ModelPool(const std::string &name) : name(name)
+{
+	this->control = map_control(name, false);
+}
+
+ModelPool::~ModelPool()
+{
+	munmap(this->control, sizeof(SharedControl));
+}
+
+std::shared_ptr<const SharedModel> ModelPool::acquire()
+{
+	SharedControl *control = (SharedControl *)this->control;
+	std::lock_guard<std::mutex> lock(this->mutex);
+
+	// The version can move on and the segment be unlinked between reading and opening it, retry
+	for (int attempt = 0; attempt < 8; attempt++)
+	{
+		uint64_t version = control->version.load(std::memory_order_acquire);
+		if (version == 0)
+		{
+			throw std::runtime_error("No version of model `" + this->name + "` has been published!");
+		}
+		if (this->current && this->current->getVersion() == version)
+		{
+			return this->current;
+		}
+
+		try
+		{
+			this->current = std::make_shared<const SharedModel>(this->name, version);
+			return this->current;
+		}
+		catch (const std::runtime_error &)
+		{
+			if (control->version.load(std::memory_order_acquire) == version)
+			{
+				throw;
+			}
+		}
+	}
+	throw std::runtime_error("Unable to map a stable version of model `" + this->name + "`!");
+}
@@ -0,0 +1,89 @@
+#ifndef SHARED_MODEL_H
+#define SHARED_MODEL_H
+
+#include "network.h"
+#include "activation.h"
+
+#include <memory> // For shared_ptr
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdint.h> // For uint64_t
+
+// Models published to POSIX shared memory so every process on a host maps the same physical
+// pages. A model named "name" has a small control segment "/name" holding the current version,
+// and one immutable segment "/name.v<version>" per published version.
+
+// Publish a network as the next version of the named model and make it current.
+// The previous version's segment is unlinked, processes still mapping it keep using it. When a
+// concurrent publish has already installed a later version, that one stays current and this
+// version's segment is unlinked instead. Returns the new version.
+uint64_t publish_model(const Network &network, const std::string &name);
+
+// Remove the named model's control segment and its current version.
+void unlink_model(const std::string &name);
+
+// Read-only mapping of one published model version.
+class SharedModel
+{
+public:
+	// Map a published version of the named model.
+	SharedModel(const std::string &name, uint64_t version);
+	~SharedModel();
+
+	SharedModel(const SharedModel &) = delete;
+	SharedModel &operator=(const SharedModel &) = delete;
+
+	// Make a prediction using the mapped weights.
+	void predict(const std::vector<double> &input, std::vector<double> &output) const;
+
+	// Get the version of the mapped model.
+	uint64_t getVersion() const;
+
+	// Get the number of inputs to the model.
+	unsigned int inputSize() const;
+
+	// Get the number of layers in the model.
+	unsigned int size() const;
+
+private:
+	// View of one layer inside the mapping.
+	struct LayerView
+	{
+		unsigned int num_neurons;
+		unsigned int num_inputs;
+		Activation activation;
+		const double *biases;  // num_neurons values.
+		const double *weights; // Row-major num_neurons x num_inputs values.
+	};
+
+	void *mapping;                 // Start of the mapped segment.
+	size_t mapping_size;           // Size of the mapped segment in bytes.
+	uint64_t version;              // Version of the model.
+	unsigned int input_size;       // Number of inputs to the model.
+	std::vector<LayerView> layers; // Layers inside the mapping.
+};
+
+// Per-process handle to a named model that follows newly published versions.
+class ModelPool
+{
+public:
+	// Attach to the named model's control segment.
+	ModelPool(const std::string &name);
+	~ModelPool();
+
+	ModelPool(const ModelPool &) = delete;
+	ModelPool &operator=(const ModelPool &) = delete;
+
+	// Get the current model, mapping a newly published version if there is one. Callers keep
+	// using the model they hold while a new version is swapped in. Thread-safe.
+	std::shared_ptr<const SharedModel> acquire();
+
+private:
+	std::string name;                           // Name of the model.
+	void *control;                              // Mapped control segment.
+	std::mutex mutex;                           // Guards current.
+	std::shared_ptr<const SharedModel> current; // Most recently mapped version.
+};
+
+#endif // SHARED_MODEL_H
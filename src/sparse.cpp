@@ -0,0 +1,236 @@
+#include "sparse.h"
+
+#include <stdexcept> // For runtime_error
+#include <algorithm> // For min, count
+
+// Number of samples processed together by the batched product
+#define SPARSE_BATCH_SIZE 16
+
+SparseNetwork::SparseNetwork(const Network &network) : input_size(network.inputSize())
+{
+	this->layers.reserve(network.size());
+	for (unsigned int l = 0; l < network.size(); l++)
+	{
+		const Layer &layer = network.getLayer(l);
+		if (layer.getType() != LayerType::Dense)
+		{
+			throw std::runtime_error("Sparse networks only support fully connected layers.");
+		}
+		std::span<const double> biases = layer.getBiases();
+
+		SparseLayer sparse;
+		sparse.num_neurons = layer.size();
+		sparse.num_inputs = layer.inputSize();
+		sparse.biases.assign(biases.begin(), biases.end());
+		sparse.activation = layer.getActivation();
+
+		std::span<const double> weights = layer.getWeights();
+		size_t zeros = std::count(weights.begin(), weights.end(), 0.0);
+		sparse.compressed = zeros >= SPARSE_MIN_SPARSITY * weights.size();
+		if (!sparse.compressed)
+		{
+			pack_weights(weights.data(), sparse.num_neurons, sparse.num_inputs, sparse.dense);
+		}
+		else
+		{
+			sparse.row_offsets.reserve(sparse.num_neurons + 1);
+			sparse.row_offsets.emplace_back(0);
+			for (unsigned int i = 0; i < sparse.num_neurons; i++)
+			{
+				std::span<const double> row = layer.getWeights(i);
+				for (uint32_t j = 0; j < row.size(); j++)
+				{
+					if (row[j] != 0.0)
+					{
+						sparse.columns.emplace_back(j);
+						sparse.values.emplace_back(row[j]);
+					}
+				}
+				sparse.row_offsets.emplace_back(sparse.values.size());
+			}
+		}
+
+		this->layers.emplace_back(std::move(sparse));
+	}
+}
+
+void SparseNetwork::activate(const SparseLayer &layer, double *values)
+{
+	for (unsigned int i = 0; i < layer.num_neurons; i++)
+	{
+		values[i] = layer.activation.function(values[i]);
+	}
+	if (layer.activation.normalize)
+	{
+		layer.activation.normalize(values, layer.num_neurons);
+	}
+}
+
+void SparseNetwork::predict(const std::vector<double> &input, std::vector<double> &output) const
+{
+	if (input.size() != this->input_size)
+	{
+		throw std::runtime_error("Input size does not match network input size.");
+	}
+
+	thread_local std::vector<double> buffer;
+
+	const std::vector<double> *current_inputs = &input;
+	for (size_t l = 0; l < this->layers.size(); l++)
+	{
+		const SparseLayer &layer = this->layers[l];
+		std::vector<double> &outputs = (this->layers.size() - 1 - l) % 2 == 0 ? output : buffer;
+		outputs.resize(layer.num_neurons);
+
+		const double *x = current_inputs->data();
+		if (!layer.compressed)
+		{
+			gemm(layer.dense, layer.biases.data(), x, outputs.data(), 1, gemm_threads(layer.dense.panels.size()));
+		}
+		else
+		{
+			for (unsigned int i = 0; i < layer.num_neurons; i++)
+			{
+				double sum = layer.biases[i];
+				for (uint32_t k = layer.row_offsets[i]; k < layer.row_offsets[i + 1]; k++)
+				{
+					sum += layer.values[k] * x[layer.columns[k]];
+				}
+				outputs[i] = sum;
+			}
+		}
+
+		activate(layer, outputs.data());
+		current_inputs = &outputs;
+	}
+}
+
+void SparseNetwork::predict(const std::vector<std::vector<double>> &inputs, std::vector<std::vector<double>> &outputs) const
+{
+	outputs.resize(inputs.size());
+
+	// Activations are kept transposed (feature-major, sample-minor) so each non-zero weight is
+	// loaded once per block and applied to the whole block with a contiguous inner loop
+	std::vector<double> current;
+	std::vector<double> next;
+	std::vector<double> sample;
+
+	for (size_t begin = 0; begin < inputs.size(); begin += SPARSE_BATCH_SIZE)
+	{
+		size_t batch = std::min<size_t>(SPARSE_BATCH_SIZE, inputs.size() - begin);
+
+		current.assign((size_t)this->input_size * batch, 0.0);
+		for (size_t b = 0; b < batch; b++)
+		{
+			if (inputs[begin + b].size() != this->input_size)
+			{
+				throw std::runtime_error("Input size does not match network input size.");
+			}
+			for (unsigned int j = 0; j < this->input_size; j++)
+			{
+				current[j * batch + b] = inputs[begin + b][j];
+			}
+		}
+
+		for (const SparseLayer &layer : this->layers)
+		{
+			if (!layer.compressed)
+			{
+				// The GEMM kernels take sample-major rows, transpose around the product
+				sample.resize((size_t)batch * layer.num_inputs);
+				for (size_t b = 0; b < batch; b++)
+				{
+					for (unsigned int j = 0; j < layer.num_inputs; j++)
+					{
+						sample[b * layer.num_inputs + j] = current[(size_t)j * batch + b];
+					}
+				}
+
+				next.resize((size_t)batch * layer.num_neurons);
+				gemm(layer.dense, layer.biases.data(), sample.data(), next.data(), batch, gemm_threads(layer.dense.panels.size() * batch));
+
+				current.resize((size_t)layer.num_neurons * batch);
+				for (size_t b = 0; b < batch; b++)
+				{
+					double *y = &next[b * layer.num_neurons];
+					activate(layer, y);
+					for (unsigned int i = 0; i < layer.num_neurons; i++)
+					{
+						current[(size_t)i * batch + b] = y[i];
+					}
+				}
+				continue;
+			}
+
+			next.resize((size_t)layer.num_neurons * batch);
+			for (unsigned int i = 0; i < layer.num_neurons; i++)
+			{
+				double *y = &next[(size_t)i * batch];
+				for (size_t b = 0; b < batch; b++)
+				{
+					y[b] = layer.biases[i];
+				}
+				for (uint32_t k = layer.row_offsets[i]; k < layer.row_offsets[i + 1]; k++)
+				{
+					double w = layer.values[k];
+					const double *x = &current[(size_t)layer.columns[k] * batch];
+					for (size_t b = 0; b < batch; b++)
+					{
+						y[b] += w * x[b];
+					}
+				}
+			}
+			current.swap(next);
+
+			// Activations work per sample, so gather each column before applying them
+			sample.resize(layer.num_neurons);
+			for (size_t b = 0; b < batch; b++)
+			{
+				for (unsigned int i = 0; i < layer.num_neurons; i++)
+				{
+					sample[i] = current[(size_t)i * batch + b];
+				}
+				activate(layer, sample.data());
+				for (unsigned int i = 0; i < layer.num_neurons; i++)
+				{
+					current[(size_t)i * batch + b] = sample[i];
+				}
+			}
+		}
+
+		unsigned int output_size = this->layers.back().num_neurons;
+		for (size_t b = 0; b < batch; b++)
+		{
+			std::vector<double> &output = outputs[begin + b];
+			output.resize(output_size);
+			for (unsigned int i = 0; i < output_size; i++)
+			{
+				output[i] = current[(size_t)i * batch + b];
+			}
+		}
+	}
+}
+
+size_t SparseNetwork::nonZeros() const
+{
+	size_t non_zeros = 0;
+	for (const SparseLayer &layer : this->layers)
+	{
+		non_zeros += layer.compressed ? layer.values.size() : (size_t)layer.num_neurons * layer.num_inputs;
+	}
+	return non_zeros;
+}
+
+size_t SparseNetwork::bytes() const
+{
+	size_t bytes = 0;
+	for (const SparseLayer &layer : this->layers)
+	{
+		bytes += layer.row_offsets.size() * sizeof(uint32_t);
+		bytes += layer.columns.size() * sizeof(uint32_t);
+		bytes += layer.values.size() * sizeof(double);
+		bytes += layer.dense.panels.size() * sizeof(double);
+		bytes += layer.biases.size() * sizeof(double);
+	}
+	return bytes;
+}
@@ -0,0 +1,59 @@
+#ifndef SPARSE_H
+#define SPARSE_H
+
+#include "network.h"
+#include "activation.h"
+#include "gemm.h"
+
+#include <vector>
+#include <stdint.h> // For uint32_t
+
+// Fraction of zero weights from which a layer is stored in CSR form. CSR keeps a 4 byte column
+// index with every 8 byte value and gathers its inputs, so below a third zeros it moves more bytes
+// than the dense rows and is slower than the GEMM kernels.
+#define SPARSE_MIN_SPARSITY (1.0 / 3.0)
+
+// Fully connected layer stored in compressed sparse row (CSR) form, keeping only non-zero weights,
+// or as packed dense panels when too few weights are zero for CSR to pay off.
+struct SparseLayer
+{
+	unsigned int num_neurons;          // Number of rows.
+	unsigned int num_inputs;           // Number of columns.
+	bool compressed;                   // Whether the weights are in CSR form rather than in dense panels.
+	PackedWeights dense;               // Weights packed for the GEMM kernels, empty when compressed.
+	std::vector<uint32_t> row_offsets; // Start of each row in columns and values, num_neurons + 1 entries.
+	std::vector<uint32_t> columns;     // Input index of each non-zero weight.
+	std::vector<double> values;        // Non-zero weights.
+	std::vector<double> biases;        // Bias for each neuron.
+	Activation activation;             // Activation function for the layer.
+};
+
+// Read-only inference copy of a (pruned) network. Layers at or above SPARSE_MIN_SPARSITY are stored
+// in CSR form, the others keep dense rows and the GEMM kernels.
+class SparseNetwork
+{
+public:
+	// Compile a network, dropping all zero weights of the layers stored in CSR form.
+	SparseNetwork(const Network &network);
+
+	// Make a prediction for a single input (sparse or dense matrix-vector product per layer).
+	void predict(const std::vector<double> &input, std::vector<double> &output) const;
+
+	// Make predictions for a batch of inputs (sparse or dense matrix-matrix product per layer).
+	void predict(const std::vector<std::vector<double>> &inputs, std::vector<std::vector<double>> &outputs) const;
+
+	// Get the number of stored weights, all weights of the dense layers and the non-zeros of the others.
+	size_t nonZeros() const;
+
+	// Get the number of bytes used by the weights, indices and biases.
+	size_t bytes() const;
+
+private:
+	unsigned int input_size;          // Number of inputs to the network.
+	std::vector<SparseLayer> layers;  // Layers in CSR form.
+
+	// Apply the layer activation in place to one output vector.
+	static void activate(const SparseLayer &layer, double *values);
+};
+
+#endif // SPARSE_H
@@ -0,0 +1,480 @@
+#include "stream.h"
+#include "random.h"
+
+#include <algorithm> // For min, max, copy
+#include <cerrno>
+#include <cstring>   // For memcpy, strerror
+#include <stdexcept> // For runtime_error
+#include <fcntl.h>   // For open, posix_fadvise
+#include <unistd.h>  // For pread, close
+
+// Magic number of the packed sample format, "NNPK" in little-endian byte order
+#define PACKED_MAGIC 0x4b504e4e
+
+// Header bytes of the packed sample format
+#define PACKED_HEADER_BYTES 24
+
+// Helper function to read exactly size bytes at offset, retrying short and interrupted reads
+static void read_fully(int fd, void *data, size_t size, size_t offset)
+{
+	uint8_t *cursor = (uint8_t *)data;
+	while (size > 0)
+	{
+		ssize_t got = pread(fd, cursor, size, offset);
+		if (got < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (got < 0)
+		{
+			throw std::runtime_error(std::string("Unable to read sample file: ") + std::strerror(errno));
+		}
+		if (got == 0)
+		{
+			throw std::runtime_error("Unexpected end of sample file.");
+		}
+		cursor += got;
+		size -= got;
+		offset += got;
+	}
+}
+
+// Helper function to open a file for reading, hinting the kernel to read ahead aggressively
+static int open_sample_file(const std::string &path)
+{
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		throw std::runtime_error("Unable to open file `" + path + "`!");
+	}
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	return fd;
+}
+
+// Helper function to read an IDX header of unsigned bytes, returning the dimensions
+static std::vector<uint32_t> read_idx_header(int fd, const std::string &path)
+{
+	uint8_t magic[4];
+	read_fully(fd, magic, sizeof(magic), 0);
+	if (magic[0] != 0 || magic[1] != 0 || magic[2] != 0x08 || magic[3] == 0)
+	{
+		throw std::runtime_error("Invalid IDX file `" + path + "`!");
+	}
+
+	std::vector<uint32_t> dimensions(magic[3]);
+	std::vector<uint8_t> bytes(4 * dimensions.size());
+	read_fully(fd, bytes.data(), bytes.size(), sizeof(magic));
+	for (size_t d = 0; d < dimensions.size(); d++)
+	{
+		// Dimensions are big-endian
+		dimensions[d] = ((uint32_t)bytes[4 * d] << 24) | ((uint32_t)bytes[4 * d + 1] << 16) | ((uint32_t)bytes[4 * d + 2] << 8) | bytes[4 * d + 3];
+	}
+	return dimensions;
+}
+
+SampleStream::SampleStream(const std::string &images_path, const std::string &labels_path, unsigned int num_classes, size_t chunk_bytes, unsigned int window_chunks, uint64_t seed)
+	: packed(false), output_size(num_classes), window_chunks(window_chunks), seed(seed)
+{
+	try
+	{
+		int images_fd = open_sample_file(images_path);
+		this->sources.push_back({images_fd, 0, 0});
+		int labels_fd = open_sample_file(labels_path);
+		this->sources.push_back({labels_fd, 0, 0});
+
+		std::vector<uint32_t> images = read_idx_header(images_fd, images_path);
+		std::vector<uint32_t> labels = read_idx_header(labels_fd, labels_path);
+		if (labels.size() != 1 || labels[0] != images[0])
+		{
+			throw std::runtime_error("IDX label file does not match the image file.");
+		}
+
+		size_t image_size = 1;
+		for (size_t d = 1; d < images.size(); d++)
+		{
+			image_size *= images[d];
+		}
+
+		this->num_samples = images[0];
+		this->input_size = image_size;
+		this->sources[0].offset = 4 + 4 * images.size();
+		this->sources[0].record_bytes = image_size;
+		this->sources[1].offset = 8;
+		this->sources[1].record_bytes = 1;
+
+		this->start(chunk_bytes);
+	}
+	catch (...)
+	{
+		for (const Source &source : this->sources)
+		{
+			close(source.fd);
+		}
+		throw;
+	}
+}
+
+SampleStream::SampleStream(const std::string &path, size_t chunk_bytes, unsigned int window_chunks, uint64_t seed)
+	: packed(true), window_chunks(window_chunks), seed(seed)
+{
+	int fd = open_sample_file(path);
+	this->sources.push_back({fd, PACKED_HEADER_BYTES, 0});
+
+	try
+	{
+		uint8_t header[PACKED_HEADER_BYTES];
+		read_fully(fd, header, sizeof(header), 0);
+
+		uint32_t magic, input_size, output_size;
+		uint64_t count;
+		std::memcpy(&magic, header, 4);
+		std::memcpy(&input_size, header + 4, 4);
+		std::memcpy(&output_size, header + 8, 4);
+		std::memcpy(&count, header + 16, 8);
+		if (magic != PACKED_MAGIC)
+		{
+			throw std::runtime_error("Invalid packed sample file `" + path + "`!");
+		}
+
+		this->num_samples = count;
+		this->input_size = input_size;
+		this->output_size = output_size;
+		this->sources[0].record_bytes = ((size_t)input_size + output_size) * sizeof(float);
+
+		this->start(chunk_bytes);
+	}
+	catch (...)
+	{
+		close(fd);
+		throw;
+	}
+}
+
+SampleStream::~SampleStream()
+{
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->stop = true;
+	}
+	this->wake.notify_one();
+	this->reader.join();
+
+	for (const Source &source : this->sources)
+	{
+		close(source.fd);
+	}
+}
+
+void SampleStream::start(size_t chunk_bytes)
+{
+	if (this->window_chunks == 0)
+	{
+		throw std::runtime_error("The shuffle window must hold at least one chunk.");
+	}
+
+	this->record_bytes = 0;
+	for (const Source &source : this->sources)
+	{
+		this->record_bytes += source.record_bytes;
+	}
+	if (this->record_bytes == 0)
+	{
+		throw std::runtime_error("Samples must hold at least one value.");
+	}
+
+	this->chunk_samples = std::max<size_t>(1, chunk_bytes / this->record_bytes);
+	this->num_chunks = (this->num_samples + this->chunk_samples - 1) / this->chunk_samples;
+
+	// Small files do not need a window larger than themselves
+	this->window_chunks = std::max<size_t>(1, std::min<size_t>(this->window_chunks, this->num_chunks));
+
+	this->window.resize(this->window_chunks * this->chunk_samples * this->record_bytes);
+	this->chunk.resize(this->chunk_samples * this->record_bytes);
+	this->prefetched.resize(this->chunk.size());
+
+	this->next_chunk = 0;
+	this->epoch = 0;
+	this->draws = 0;
+	this->window_count = 0;
+	this->requested = -1;
+	this->pending = false;
+	this->loaded = false;
+	this->stop = false;
+
+	this->reader = std::thread(&SampleStream::read, this);
+	this->begin(0);
+}
+
+size_t SampleStream::size() const
+{
+	return this->num_samples;
+}
+
+unsigned int SampleStream::inputSize() const
+{
+	return this->input_size;
+}
+
+unsigned int SampleStream::outputSize() const
+{
+	return this->output_size;
+}
+
+void SampleStream::begin(uint64_t epoch)
+{
+	// A chunk still in flight from the previous epoch is waited for and dropped
+	{
+		std::unique_lock<std::mutex> lock(this->mutex);
+		this->done.wait(lock, [&]() { return !this->pending || this->loaded; });
+		this->pending = false;
+		this->loaded = false;
+	}
+
+	this->epoch = epoch;
+	this->draws = 0;
+	this->window_count = 0;
+	this->next_chunk = 0;
+	this->order = random_permutation(this->seed, epoch, this->num_chunks);
+
+	if (this->num_chunks > 0)
+	{
+		this->request(this->order[0]);
+	}
+}
+
+bool SampleStream::next(std::vector<double> &input, std::vector<double> &target)
+{
+	// Top the window up whenever a whole chunk fits
+	while (this->next_chunk < this->num_chunks && this->window_count + this->chunk_samples <= this->window_chunks * this->chunk_samples)
+	{
+		this->take();
+	}
+
+	if (this->window_count == 0)
+	{
+		return false;
+	}
+
+	// Draw a random record and fill its slot with the last one
+	size_t index = random_bits(this->seed, this->epoch, this->draws++) % this->window_count;
+	uint8_t *record = &this->window[index * this->record_bytes];
+
+	input.resize(this->input_size);
+	target.resize(this->output_size);
+	if (this->packed)
+	{
+		const uint8_t *values = record;
+		for (unsigned int i = 0; i < this->input_size; i++, values += sizeof(float))
+		{
+			float value;
+			std::memcpy(&value, values, sizeof(float));
+			input[i] = value;
+		}
+		for (unsigned int i = 0; i < this->output_size; i++, values += sizeof(float))
+		{
+			float value;
+			std::memcpy(&value, values, sizeof(float));
+			target[i] = value;
+		}
+	}
+	else
+	{
+		for (unsigned int i = 0; i < this->input_size; i++)
+		{
+			input[i] = record[i] / 255.0;
+		}
+
+		unsigned int label = record[this->input_size];
+		if (label >= this->output_size)
+		{
+			throw std::runtime_error("Label does not match the number of classes.");
+		}
+		std::fill(target.begin(), target.end(), 0.0);
+		target[label] = 1.0;
+	}
+
+	this->window_count--;
+	if (index != this->window_count)
+	{
+		std::memcpy(record, &this->window[this->window_count * this->record_bytes], this->record_bytes);
+	}
+	return true;
+}
+
+void SampleStream::request(size_t chunk_index)
+{
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->requested = chunk_index;
+		this->pending = true;
+	}
+	this->wake.notify_one();
+}
+
+void SampleStream::take()
+{
+	size_t chunk_index = this->order[this->next_chunk++];
+	{
+		std::unique_lock<std::mutex> lock(this->mutex);
+		this->done.wait(lock, [&]() { return this->loaded; });
+		this->loaded = false;
+		this->pending = false;
+		if (this->failure)
+		{
+			std::exception_ptr failure = this->failure;
+			this->failure = nullptr;
+			std::rethrow_exception(failure);
+		}
+		std::swap(this->chunk, this->prefetched);
+	}
+
+	// The next read overlaps with unpacking this chunk and training on the window
+	if (this->next_chunk < this->num_chunks)
+	{
+		this->request(this->order[this->next_chunk]);
+	}
+
+	// Interleave the sources' segments into whole records at the end of the window
+	size_t first = chunk_index * this->chunk_samples;
+	size_t count = std::min(this->chunk_samples, this->num_samples - first);
+	uint8_t *records = &this->window[this->window_count * this->record_bytes];
+	const uint8_t *segment = this->chunk.data();
+	size_t column = 0;
+	for (const Source &source : this->sources)
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			std::memcpy(records + i * this->record_bytes + column, segment + i * source.record_bytes, source.record_bytes);
+		}
+		segment += this->chunk_samples * source.record_bytes;
+		column += source.record_bytes;
+	}
+	this->window_count += count;
+}
+
+void SampleStream::read()
+{
+	while (true)
+	{
+		size_t chunk_index;
+		{
+			std::unique_lock<std::mutex> lock(this->mutex);
+			this->wake.wait(lock, [&]() { return this->requested >= 0 || this->stop; });
+			if (this->stop)
+			{
+				return;
+			}
+			chunk_index = this->requested;
+			this->requested = -1;
+		}
+
+		size_t first = chunk_index * this->chunk_samples;
+		size_t count = std::min(this->chunk_samples, this->num_samples - first);
+
+		// One large read per source, then drop the pages so a dataset larger than memory does not
+		// push everything else out of the page cache
+		std::exception_ptr failure;
+		try
+		{
+			uint8_t *segment = this->prefetched.data();
+			for (const Source &source : this->sources)
+			{
+				size_t offset = source.offset + first * source.record_bytes;
+				read_fully(source.fd, segment, count * source.record_bytes, offset);
+				posix_fadvise(source.fd, offset, count * source.record_bytes, POSIX_FADV_DONTNEED);
+				segment += this->chunk_samples * source.record_bytes;
+			}
+		}
+		catch (...)
+		{
+			failure = std::current_exception();
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->failure = failure;
+			this->loaded = true;
+		}
+		this->done.notify_one();
+	}
+}
+
+PackedSampleWriter::PackedSampleWriter(const std::string &path, unsigned int input_size, unsigned int output_size)
+	: input_size(input_size), output_size(output_size), count(0)
+{
+	this->file = fopen(path.c_str(), "wb");
+	if (!this->file)
+	{
+		throw std::runtime_error("Unable to open file `" + path + "`!");
+	}
+
+	// The count is filled in when the writer is closed
+	uint8_t header[PACKED_HEADER_BYTES] = {};
+	uint32_t magic = PACKED_MAGIC;
+	std::memcpy(header, &magic, 4);
+	std::memcpy(header + 4, &input_size, 4);
+	std::memcpy(header + 8, &output_size, 4);
+	if (fwrite(header, 1, sizeof(header), this->file) != sizeof(header))
+	{
+		fclose(this->file);
+		throw std::runtime_error("Unable to write packed sample file `" + path + "`!");
+	}
+
+	this->record.resize((size_t)input_size + output_size);
+}
+
+PackedSampleWriter::~PackedSampleWriter()
+{
+	try
+	{
+		this->close();
+	}
+	catch (const std::runtime_error &)
+	{
+	}
+}
+
+void PackedSampleWriter::close()
+{
+	if (!this->file)
+	{
+		return;
+	}
+
+	// fclose flushes the buffered records, so its result covers them too
+	FILE *file = this->file;
+	this->file = nullptr;
+	bool written = fseek(file, 16, SEEK_SET) == 0 && fwrite(&this->count, sizeof(this->count), 1, file) == 1;
+	if (fclose(file) != 0 || !written)
+	{
+		throw std::runtime_error("Unable to write packed sample file.");
+	}
+}
+
+void PackedSampleWriter::write(std::span<const double> input, std::span<const double> target)
+{
+	if (input.size() != this->input_size || target.size() != this->output_size)
+	{
+		throw std::runtime_error("Sample size does not match the packed file.");
+	}
+	if (!this->file)
+	{
+		throw std::runtime_error("Packed sample file is closed.");
+	}
+
+	std::copy(input.begin(), input.end(), this->record.begin());
+	std::copy(target.begin(), target.end(), this->record.begin() + this->input_size);
+	if (fwrite(this->record.data(), sizeof(float), this->record.size(), this->file) != this->record.size())
+	{
+		throw std::runtime_error("Unable to write packed sample file.");
+	}
+	this->count++;
+}
+
+void PackedSampleWriter::write(const Dataset &dataset)
+{
+	for (size_t i = 0; i < dataset.size(); i++)
+	{
+		this->write(dataset.inputs[i], dataset.targets[i]);
+	}
+}
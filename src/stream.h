@@ -0,0 +1,143 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "dataset.h"
+
+#include <condition_variable>
+#include <cstdio>    // For FILE
+#include <exception> // For exception_ptr
+#include <mutex>
+#include <span>
+#include <stdint.h>  // For uint8_t, uint64_t
+#include <string>
+#include <thread>
+#include <vector>
+
+// Default bytes of samples per chunk read from disk.
+#define STREAM_CHUNK_BYTES (4 << 20)
+
+// Default number of chunks resident in the shuffle window.
+#define STREAM_WINDOW_CHUNKS 16
+
+// Streams labelled samples from files larger than memory. Samples are read in chunks of consecutive
+// records with large pread calls, one chunk ahead on a reader thread, and shuffled within a sliding
+// window of chunks: every epoch visits the chunks in a new random order, and each sample handed out
+// is drawn at random from the window, whose freed space is refilled with the next chunk. Memory stays
+// at window_chunks + 2 chunks of raw records however large the files are.
+class SampleStream
+{
+public:
+	// Stream an IDX file of unsigned byte images, of any number of dimensions, with its IDX label
+	// file. Inputs are scaled to [0, 1] and labels become one-hot targets of num_classes values.
+	SampleStream(const std::string &images_path, const std::string &labels_path, unsigned int num_classes = 10, size_t chunk_bytes = STREAM_CHUNK_BYTES, unsigned int window_chunks = STREAM_WINDOW_CHUNKS, uint64_t seed = 0);
+
+	// Stream a packed sample file written by PackedSampleWriter.
+	SampleStream(const std::string &path, size_t chunk_bytes = STREAM_CHUNK_BYTES, unsigned int window_chunks = STREAM_WINDOW_CHUNKS, uint64_t seed = 0);
+
+	~SampleStream();
+
+	SampleStream(const SampleStream &) = delete;
+	SampleStream &operator=(const SampleStream &) = delete;
+
+	// Get the number of samples.
+	size_t size() const;
+
+	// Get the number of values per input.
+	unsigned int inputSize() const;
+
+	// Get the number of values per target.
+	unsigned int outputSize() const;
+
+	// Start an epoch, discarding what is left of the previous one. The order depends only on the
+	// seed and the epoch.
+	void begin(uint64_t epoch);
+
+	// Get the next sample of the epoch. Returns false once every sample has been handed out.
+	bool next(std::vector<double> &input, std::vector<double> &target);
+
+private:
+	// A file holding one fixed-size record per sample after a header.
+	struct Source
+	{
+		int fd;              // Open file.
+		size_t offset;       // Bytes before the first record.
+		size_t record_bytes; // Bytes per record.
+	};
+
+	std::vector<Source> sources; // Image and label files, or the packed file.
+	bool packed;                 // Records are float32 values rather than IDX bytes.
+	size_t num_samples;          // Number of samples.
+	unsigned int input_size;     // Values per input.
+	unsigned int output_size;    // Values per target.
+	size_t record_bytes;         // Bytes per sample across all sources.
+	size_t chunk_samples;        // Samples per chunk.
+	size_t num_chunks;           // Number of chunks.
+	unsigned int window_chunks;  // Chunks resident in the window.
+	uint64_t seed;               // Seed of the chunk order and the draws.
+
+	std::vector<size_t> order;   // Chunk order of the current epoch.
+	size_t next_chunk;           // Position in order of the next chunk to enter the window.
+	uint64_t epoch;              // Current epoch.
+	uint64_t draws;              // Samples drawn this epoch.
+	std::vector<uint8_t> window; // Raw records of the samples not drawn yet.
+	size_t window_count;         // Number of records in the window.
+	std::vector<uint8_t> chunk;  // Raw chunk being moved into the window, one segment per source.
+
+	std::thread reader;               // Background chunk reader.
+	std::mutex mutex;                 // Guards the reader's request and result.
+	std::condition_variable wake;     // Signalled when a chunk is requested or on shutdown.
+	std::condition_variable done;     // Signalled when a requested chunk is loaded.
+	long requested;                   // Chunk the reader should load next, or -1.
+	bool pending;                     // A requested chunk has not been taken yet.
+	bool loaded;                      // The prefetched buffer holds the pending chunk.
+	bool stop;                        // Set to shut the reader down.
+	std::exception_ptr failure;       // Error of the last read, rethrown when its chunk is taken.
+	std::vector<uint8_t> prefetched;  // Chunk loaded by the reader.
+
+	// Size the buffers and start the reader once the record layout is known.
+	void start(size_t chunk_bytes);
+
+	// Background loop loading requested chunks.
+	void read();
+
+	// Ask the reader for a chunk.
+	void request(size_t chunk_index);
+
+	// Wait for the pending chunk, request the one after it and append its records to the window.
+	void take();
+};
+
+// Writes the packed sample format read by SampleStream: a header of the magic "NNPK", the input
+// size, the output size and a reserved word as uint32 values and the sample count as a uint64,
+// followed by the input and target values of each sample as float32, all in host byte order.
+// Samples are appended one at a time, so files larger than memory can be written.
+class PackedSampleWriter
+{
+public:
+	PackedSampleWriter(const std::string &path, unsigned int input_size, unsigned int output_size);
+
+	// Close the file if close() was not called. Errors are ignored here, call close() to see them.
+	~PackedSampleWriter();
+
+	PackedSampleWriter(const PackedSampleWriter &) = delete;
+	PackedSampleWriter &operator=(const PackedSampleWriter &) = delete;
+
+	// Append a sample.
+	void write(std::span<const double> input, std::span<const double> target);
+
+	// Append every sample of a dataset.
+	void write(const Dataset &dataset);
+
+	// Write the final sample count into the header and close the file, throwing if any of it
+	// fails. Does nothing once closed.
+	void close();
+
+private:
+	FILE *file;                 // Output file.
+	unsigned int input_size;    // Values per input.
+	unsigned int output_size;   // Values per target.
+	uint64_t count;             // Samples written.
+	std::vector<float> record;  // Conversion buffer of one sample.
+};
+
+#endif // STREAM_H
@@ -0,0 +1,190 @@
+#include "sweep.h"
+#include "data.h"
+#include "team.h"
+
+#include <algorithm> // For sort, find
+#include <atomic>
+#include <chrono>    // For steady_clock
+#include <cstdio>
+#include <exception> // For exception_ptr
+#include <fstream>
+#include <mutex>
+#include <numeric>   // For iota
+#include <set>
+#include <stdexcept> // For runtime_error
+#include <sstream>   // For ostringstream
+#include <thread>
+
+std::vector<SweepJob> sweep_grid(const std::vector<std::vector<unsigned int>> &shapes, const std::vector<double> &learning_rates, const std::vector<Activation> &activations, int epochs, Activation output_activation)
+{
+	std::vector<SweepJob> jobs;
+	jobs.reserve(shapes.size() * learning_rates.size() * activations.size());
+
+	for (const std::vector<unsigned int> &shape : shapes)
+	{
+		for (double learning_rate : learning_rates)
+		{
+			for (const Activation &activation : activations)
+			{
+				jobs.push_back({shape, learning_rate, activation, output_activation, epochs, 0});
+			}
+		}
+	}
+	return jobs;
+}
+
+std::string sweep_filename(const SweepJob &job)
+{
+	std::ostringstream filename;
+	filename << "network";
+	for (unsigned int size : job.shape)
+	{
+		filename << "-" << size;
+	}
+	filename << "-" << ActivationFunctions::name(job.activation) << "-" << ActivationFunctions::name(job.output_activation) << "-" << job.learning_rate;
+	filename << "-e" << job.epochs << "-s" << job.seed << ".json";
+	return filename.str();
+}
+
+// Training cost of a job, proportional to weights times epochs.
+static double job_cost(const SweepJob &job)
+{
+	double weights = 0.0;
+	for (size_t l = 1; l < job.shape.size(); l++)
+	{
+		weights += (double)job.shape[l] * (job.shape[l - 1] + 1);
+	}
+	return weights * job.epochs;
+}
+
+std::vector<SweepResult> run_sweep(const std::vector<SweepJob> &jobs, const Dataset &training, const Dataset &test, const std::string &output_directory, unsigned int num_threads)
+{
+	// Reject malformed jobs up front rather than on a worker halfway through the sweep
+	std::set<std::string> filenames;
+	for (const SweepJob &job : jobs)
+	{
+		if (job.shape.size() < 2)
+		{
+			throw std::runtime_error("Sweep job shapes need an input and at least one layer.");
+		}
+		if (std::find(job.shape.begin(), job.shape.end(), 0u) != job.shape.end())
+		{
+			throw std::runtime_error("Sweep job layer sizes must be positive.");
+		}
+		if (!training.inputs.empty() && (job.shape.front() != training.inputs[0].size() || job.shape.back() != training.targets[0].size()))
+		{
+			throw std::runtime_error("Sweep job shape does not match the training data.");
+		}
+		if (!filenames.insert(sweep_filename(job)).second)
+		{
+			throw std::runtime_error("Sweep jobs must be distinct, `" + sweep_filename(job) + "` is listed twice.");
+		}
+	}
+
+	// Largest first: greedy list scheduling of the longest jobs keeps the last worker from finishing late
+	std::vector<size_t> order(jobs.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+					 { return job_cost(jobs[a]) > job_cost(jobs[b]); });
+
+	if (num_threads == 0)
+	{
+		num_threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	num_threads = std::min<size_t>(num_threads, jobs.size());
+
+	std::vector<SweepResult> results(jobs.size());
+	std::atomic<size_t> next_job(0);
+	std::atomic<size_t> finished(0);
+	std::mutex print_mutex;
+	std::exception_ptr failure; // First job error, guarded by print_mutex.
+
+	// Evaluation and training inside a job stay on the job's thread
+	auto worker = [&]()
+	{
+		WorkerScope scope(num_threads > 1);
+		for (size_t index = next_job++; index < order.size(); index = next_job++)
+		{
+			const SweepJob &job = jobs[order[index]];
+			SweepResult &result = results[order[index]];
+			try
+			{
+				Network network(job.shape[0]);
+				for (size_t l = 1; l < job.shape.size(); l++)
+				{
+					network.addLayer(job.shape[l], l + 1 == job.shape.size() ? job.output_activation : job.activation);
+				}
+				network.initialize(Initialization::Xavier, job.seed);
+				network.setVerbose(false);
+
+				std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+				network.train(training.inputs, training.targets, job.learning_rate, job.epochs);
+				std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+				result.job = job;
+				result.seconds = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count() / 1000.0;
+				result.evaluation = evaluate(network, test, 3, 1);
+				result.filename = output_directory + "/" + sweep_filename(job);
+
+				if (!export_network(network, result.filename))
+				{
+					throw std::runtime_error("Unable to export model `" + result.filename + "`.");
+				}
+			}
+			catch (...)
+			{
+				// Keep the first error and stop handing out jobs, running ones finish
+				std::lock_guard<std::mutex> lock(print_mutex);
+				if (!failure)
+				{
+					failure = std::current_exception();
+				}
+				next_job = order.size();
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock(print_mutex);
+			printf("[%zu/%zu] %s - Accuracy: %.2f%% - Time: %.2fs\n", ++finished, jobs.size(), sweep_filename(job).c_str(), result.evaluation.accuracy * 100, result.seconds);
+			fflush(stdout);
+		}
+	};
+
+	std::vector<std::thread> threads;
+	threads.reserve(num_threads);
+	for (unsigned int t = 0; t < num_threads; t++)
+	{
+		threads.emplace_back(worker);
+	}
+	for (std::thread &thread : threads)
+	{
+		thread.join();
+	}
+
+	if (failure)
+	{
+		std::rethrow_exception(failure);
+	}
+	return results;
+}
+
+void write_sweep_results(const std::vector<SweepResult> &results, const std::string &filename)
+{
+	std::ofstream file(filename);
+	if (!file.is_open())
+	{
+		throw std::runtime_error("Unable to open file `" + filename + "`!");
+	}
+
+	file << "shape\tactivation\tlearning_rate\tepochs\taccuracy\ttop_k_accuracy\tloss\tseconds\tmodel\n";
+	for (const SweepResult &result : results)
+	{
+		std::string shape;
+		for (size_t l = 0; l < result.job.shape.size(); l++)
+		{
+			shape += (l ? "-" : "") + std::to_string(result.job.shape[l]);
+		}
+
+		file << shape << "\t" << ActivationFunctions::name(result.job.activation) << "\t" << result.job.learning_rate << "\t" << result.job.epochs << "\t"
+			 << result.evaluation.accuracy << "\t" << result.evaluation.top_k_accuracy << "\t" << result.evaluation.mean_loss << "\t" << result.seconds << "\t" << result.filename << "\n";
+	}
+}
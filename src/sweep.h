@@ -0,0 +1,50 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include "network.h"
+#include "activation.h"
+#include "dataset.h"
+#include "evaluation.h"
+
+#include <string>
+#include <vector>
+
+// One training run of a sweep.
+struct SweepJob
+{
+	std::vector<unsigned int> shape; // Layer sizes including the input, e.g. {784, 16, 10}.
+	double learning_rate;            // Learning rate for training.
+	Activation activation;           // Activation of the hidden layers.
+	Activation output_activation;    // Activation of the output layer.
+	int epochs;                      // Number of training epochs.
+	uint64_t seed;                   // Initialization seed.
+};
+
+// Outcome of one sweep job.
+struct SweepResult
+{
+	SweepJob job;          // The job that was run.
+	Evaluation evaluation; // Scores on the test set.
+	double seconds;        // Wall time spent training.
+	std::string filename;  // Exported model file.
+};
+
+// Build the cross product of shapes, learning rates and hidden activations.
+std::vector<SweepJob> sweep_grid(const std::vector<std::vector<unsigned int>> &shapes, const std::vector<double> &learning_rates, const std::vector<Activation> &activations, int epochs, Activation output_activation = ActivationFunctions::softmax);
+
+// Get the file name of a job's model from every field of the job, so distinct jobs never share a
+// file, e.g. network-784-16-10-sigmoid-softmax-0.1-e10-s0.json.
+std::string sweep_filename(const SweepJob &job);
+
+// Train every job concurrently on a thread pool sharing the read-only datasets. Jobs are started
+// largest first (by weights x epochs) to minimize the makespan. Each model is exported to
+// output_directory and results are returned in job order. Uses all hardware threads when
+// num_threads is 0. Jobs are validated and must be distinct before any starts; if a job fails,
+// including its export, no new jobs are started and its error is rethrown once the running ones
+// finish.
+std::vector<SweepResult> run_sweep(const std::vector<SweepJob> &jobs, const Dataset &training, const Dataset &test, const std::string &output_directory, unsigned int num_threads = 0);
+
+// Write the sweep results as a tab-separated table.
+void write_sweep_results(const std::vector<SweepResult> &results, const std::string &filename);
+
+#endif // SWEEP_H
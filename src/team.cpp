@@ -0,0 +1,193 @@
+#include "team.h"
+
+#include <algorithm> // For min, max
+#include <mutex>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h> // For _mm_pause
+#define TEAM_PAUSE() _mm_pause()
+#else
+#define TEAM_PAUSE()
+#endif
+
+// Spins before a run() or barrier waiter starts yielding
+#define TEAM_SPIN_LIMIT (1 << 10)
+
+// Pauses between clock reads of a spinning idle worker
+#define TEAM_CLOCK_INTERVAL 64
+
+// Set on threads that must not fan out again: workers running a task and threads inside a WorkerScope
+static thread_local bool worker_thread = false;
+
+// Held by the thread running parallel_ranges() on the shared team
+static std::mutex shared_team_mutex;
+
+ThreadTeam::ThreadTeam(unsigned int num_threads, unsigned int spin_microseconds)
+	: num_threads(std::max(1u, num_threads)), task(nullptr), generation(0), remaining(0), sleepers(0), stop(false), spin_microseconds(spin_microseconds), barrier_count(0), barrier_generation(0)
+{
+	this->workers.reserve(this->num_threads - 1);
+	for (unsigned int index = 1; index < this->num_threads; index++)
+	{
+		this->workers.emplace_back(&ThreadTeam::work, this, index);
+	}
+}
+
+ThreadTeam::~ThreadTeam()
+{
+	this->stop.store(true);
+	this->generation.fetch_add(1);
+	this->generation.notify_all();
+	for (std::thread &worker : this->workers)
+	{
+		worker.join();
+	}
+}
+
+unsigned int ThreadTeam::size() const
+{
+	return this->num_threads;
+}
+
+void ThreadTeam::setSpinTime(unsigned int microseconds)
+{
+	this->spin_microseconds.store(microseconds, std::memory_order_relaxed);
+}
+
+void ThreadTeam::run(const std::function<void(unsigned int)> &task)
+{
+	this->task = &task;
+	this->remaining.store(this->num_threads - 1, std::memory_order_relaxed);
+
+	// Sleeping workers need a notification, spinning ones see the new generation directly
+	this->generation.fetch_add(1);
+	if (this->sleepers.load() > 0)
+	{
+		this->generation.notify_all();
+	}
+
+	bool previous = worker_thread;
+	worker_thread = true;
+	task(0);
+	worker_thread = previous;
+
+	unsigned int spins = 0;
+	while (this->remaining.load(std::memory_order_acquire) != 0)
+	{
+		if (++spins < TEAM_SPIN_LIMIT)
+		{
+			TEAM_PAUSE();
+		}
+		else
+		{
+			std::this_thread::yield();
+		}
+	}
+	this->task = nullptr;
+}
+
+void ThreadTeam::barrier()
+{
+	uint64_t current = this->barrier_generation.load(std::memory_order_acquire);
+
+	// The last worker to arrive resets the count and releases the others
+	if (this->barrier_count.fetch_add(1, std::memory_order_acq_rel) + 1 == this->num_threads)
+	{
+		this->barrier_count.store(0, std::memory_order_relaxed);
+		this->barrier_generation.fetch_add(1, std::memory_order_release);
+		return;
+	}
+
+	unsigned int spins = 0;
+	while (this->barrier_generation.load(std::memory_order_acquire) == current)
+	{
+		if (++spins < TEAM_SPIN_LIMIT)
+		{
+			TEAM_PAUSE();
+		}
+		else
+		{
+			std::this_thread::yield();
+		}
+	}
+}
+
+void ThreadTeam::work(unsigned int index)
+{
+	worker_thread = true;
+	uint64_t seen = 0;
+	while (true)
+	{
+		// Spin for the next task for the spin time, then block until run() or the destructor notifies
+		std::chrono::steady_clock::time_point spin_end = std::chrono::steady_clock::now() + std::chrono::microseconds(this->spin_microseconds.load(std::memory_order_relaxed));
+		unsigned int spins = 0;
+		uint64_t current;
+		while ((current = this->generation.load(std::memory_order_acquire)) == seen)
+		{
+			if (spins++ % TEAM_CLOCK_INTERVAL != 0 || std::chrono::steady_clock::now() < spin_end)
+			{
+				TEAM_PAUSE();
+				continue;
+			}
+			this->sleepers.fetch_add(1);
+			this->generation.wait(seen);
+			this->sleepers.fetch_sub(1);
+		}
+		seen = current;
+
+		if (this->stop.load())
+		{
+			return;
+		}
+
+		(*this->task)(index);
+		this->remaining.fetch_sub(1, std::memory_order_release);
+	}
+}
+
+WorkerScope::WorkerScope(bool active) : previous(worker_thread)
+{
+	worker_thread = worker_thread || active;
+}
+
+WorkerScope::~WorkerScope()
+{
+	worker_thread = this->previous;
+}
+
+// Team with a worker per hardware thread, started by the first parallel_ranges() call that needs it
+static ThreadTeam &shared_team()
+{
+	static ThreadTeam team(std::max(1u, std::thread::hardware_concurrency()));
+	return team;
+}
+
+void parallel_ranges(unsigned int count, unsigned int num_threads, const std::function<void(unsigned int, unsigned int)> &body, unsigned int granularity)
+{
+	granularity = std::max(1u, granularity);
+	unsigned int units = (count + granularity - 1) / granularity;
+	num_threads = std::max(1u, std::min(num_threads, units));
+
+	if (num_threads > 1 && !worker_thread)
+	{
+		// A busy team means another thread is already using every core
+		std::unique_lock<std::mutex> lock(shared_team_mutex, std::try_to_lock);
+		if (lock.owns_lock())
+		{
+			ThreadTeam &team = shared_team();
+			num_threads = std::min(num_threads, team.size());
+			unsigned int chunk = (units + num_threads - 1) / num_threads * granularity;
+
+			team.run([&](unsigned int worker)
+			{
+				unsigned int begin = worker * chunk;
+				if (worker < num_threads && begin < count)
+				{
+					body(begin, std::min(begin + chunk, count));
+				}
+			});
+			return;
+		}
+	}
+
+	body(0u, count);
+}
@@ -0,0 +1,82 @@
+#ifndef TEAM_H
+#define TEAM_H
+
+#include <atomic>
+#include <chrono>     // For steady_clock
+#include <functional> // For function
+#include <thread>
+#include <vector>
+#include <stdint.h>   // For uint64_t
+
+// Default time idle workers spin for the next task before blocking, in microseconds.
+#define TEAM_SPIN_MICROSECONDS 50
+
+// Persistent team of worker threads for short parallel tasks. Idle workers spin on the task
+// generation for a while before falling back to a blocking wait, so a task starts on every worker
+// within nanoseconds of run() when tasks follow each other closely.
+class ThreadTeam
+{
+public:
+	// Start num_threads - 1 workers, the thread calling run() is worker 0.
+	ThreadTeam(unsigned int num_threads, unsigned int spin_microseconds = TEAM_SPIN_MICROSECONDS);
+	~ThreadTeam();
+
+	ThreadTeam(const ThreadTeam &) = delete;
+	ThreadTeam &operator=(const ThreadTeam &) = delete;
+
+	// Get the number of workers, including the calling thread.
+	unsigned int size() const;
+
+	// Set how long idle workers spin for the next task before blocking. Longer spins keep wake-up
+	// latency low across larger gaps between tasks at the cost of busy idle cores, 0 blocks at once.
+	void setSpinTime(unsigned int microseconds);
+
+	// Run task(worker) on every worker and return once all of them have finished.
+	// Must not be called concurrently or from inside a task.
+	void run(const std::function<void(unsigned int)> &task);
+
+	// Wait until every worker of the running task has reached the barrier. Only valid inside a task,
+	// and every worker must reach the same number of barriers.
+	void barrier();
+
+private:
+	unsigned int num_threads;                     // Number of workers, including the caller.
+	std::vector<std::thread> workers;             // Worker threads 1 to num_threads - 1.
+	const std::function<void(unsigned int)> *task; // Task of the current generation.
+
+	std::atomic<uint64_t> generation;            // Incremented to start a task.
+	std::atomic<unsigned int> remaining;         // Workers still running the current task.
+	std::atomic<unsigned int> sleepers;          // Workers blocked waiting for the next generation.
+	std::atomic<bool> stop;                      // Set to shut the workers down.
+	std::atomic<unsigned int> spin_microseconds; // Idle spin time before blocking.
+
+	std::atomic<unsigned int> barrier_count;      // Workers that have reached the current barrier.
+	std::atomic<uint64_t> barrier_generation;     // Incremented when every worker has reached it.
+
+	// Worker loop of thread index.
+	void work(unsigned int index);
+};
+
+// Marks the calling thread as a worker while in scope, so parallel_ranges() calls made from it run on
+// the thread alone. Threads that are already part of parallel work use it to avoid oversubscription.
+class WorkerScope
+{
+public:
+	// Only marks the thread when active, so single-threaded callers keep their parallel kernels.
+	explicit WorkerScope(bool active = true);
+	~WorkerScope();
+
+	WorkerScope(const WorkerScope &) = delete;
+	WorkerScope &operator=(const WorkerScope &) = delete;
+
+private:
+	bool previous; // Mark of the thread before the scope.
+};
+
+// Run body(begin, end) over [0, count) in up to num_threads ranges whose bounds are multiples of
+// granularity, on a team shared by the whole process and started on first use. The calling thread runs
+// the first range. Everything runs on the calling thread when it is a team worker, inside a WorkerScope,
+// or when another thread is using the shared team.
+void parallel_ranges(unsigned int count, unsigned int num_threads, const std::function<void(unsigned int, unsigned int)> &body, unsigned int granularity = 1);
+
+#endif // TEAM_H